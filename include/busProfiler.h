@@ -0,0 +1,99 @@
+#ifndef D4A811B0_8412_4F72_8852_B577D72A41CC
+#define D4A811B0_8412_4F72_8852_B577D72A41CC
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+
+/**
+ * Number of bits of one display frame including header.
+ */
+#define DISPLAY_FRAME_BITS 137
+
+/**
+ * Number of frames aggregated before window statistics are published.
+ */
+#define BUS_PROFILE_WINDOW_FRAMES 256
+
+#define BUS_HISTOGRAM_BINS 16
+// width of one bin of frame period histogram, the last bin counts all longer periods
+#define BUS_PERIOD_BIN_US 5000
+// width of one bin of jitter histogram, jitter is deviation of period from average of previous window
+#define BUS_JITTER_BIN_US 250
+
+/**
+ * Statistics of display bus over the last complete window. Times are in microseconds.
+ */
+struct BusProfile {
+    uint32_t frames;
+    uint32_t periodAvgUs;
+    uint32_t periodMinUs;
+    uint32_t periodMaxUs;
+    uint32_t jitterMaxUs;
+    // time CS is low while frame is transferred
+    uint32_t csLowAvgUs;
+    // average clock rate while CS is low
+    uint32_t clockKHz;
+    // time from CS going high to completion of SPI transaction
+    uint32_t completionLatencyAvgUs;
+};
+
+/**
+ * Measures timing of display bus: CS edges are timestamped by interrupt, SPI transaction completion by post
+ * transaction callback. Updated from interrupts of display task core, results can be read from any task.
+ */
+class BusProfiler {
+    portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+    int64_t csFallUs = 0;
+    int64_t csRiseUs = 0;
+
+    // current window
+    uint32_t windowFrames = 0;
+    uint64_t windowPeriodSumUs = 0;
+    uint32_t windowPeriodMinUs = UINT32_MAX;
+    uint32_t windowPeriodMaxUs = 0;
+    uint32_t windowJitterMaxUs = 0;
+    uint64_t windowCsLowSumUs = 0;
+    uint32_t windowCsLowCount = 0;
+    uint64_t windowLatencySumUs = 0;
+    uint32_t windowLatencyCount = 0;
+
+    BusProfile published = {};
+    uint32_t periodHistogram[BUS_HISTOGRAM_BINS] = {};
+    uint32_t jitterHistogram[BUS_HISTOGRAM_BINS] = {};
+    // incremented whenever a window is published
+    volatile uint32_t publishCount = 0;
+    volatile uint32_t frameCount = 0;
+
+    void publishWindow();
+
+public:
+    void onCsEdge(bool high);
+    void onTransactionDone();
+
+    /**
+     * Returns statistics of the last complete window, frames is 0 until the first window is complete.
+     */
+    BusProfile getProfile();
+    /**
+     * Copies histograms of frame period and jitter since start or reset.
+     */
+    void getHistograms(uint32_t* period, uint32_t* jitter);
+    uint32_t getPublishCount() {
+        return publishCount;
+    }
+    /**
+     * Returns number of frames started on the bus (CS falling edges) since start.
+     */
+    uint32_t getFrameCount() {
+        return frameCount;
+    }
+    void reset();
+};
+
+/**
+ * Derives display task period, SPI timeout and settle reads from measured frame cadence of all units when enabled
+ * by hregTuneAutoBus. Called by display task.
+ */
+void autoTuneBusTiming();
+
+#endif /* D4A811B0_8412_4F72_8852_B577D72A41CC */
@@ -0,0 +1,69 @@
+#ifndef F9BD459B_4F43_4B8A_BC89_E3E34510BAB4
+#define F9BD459B_4F43_4B8A_BC89_E3E34510BAB4
+
+#include <cstdint>
+#include <freertos/FreeRTOS.h>
+
+/**
+ * Number of events kept in trace buffer, the oldest ones are overwritten.
+ */
+#define TRACE_BUFFER_SIZE 256
+
+enum TRACE_EVENT : uint8_t {
+    // command received by modbus callback and claimed, arg is KEY_SEQUENCE, value target value
+    teCommandReceived = 0,
+    // command rejected because another one is in progress
+    teCommandRejected,
+    // command handed over to display task
+    teCommandPosted,
+    // requester got result of command, value 1 for success
+    teCommandResult,
+    // key sequence started by display task, arg is KEY_SEQUENCE
+    teSequenceStarted,
+    teSequenceFinished,
+    // arg is KEYS, value duration in ms
+    teKeyDown,
+    teKeyUp,
+    // display frame confirmed step of sequence, arg is MODE
+    teStepConfirmed,
+};
+
+struct TraceEvent {
+    uint64_t timeUs;
+    uint16_t value;
+    TRACE_EVENT type;
+    uint8_t unit;
+    uint8_t step;
+    uint8_t arg;
+};
+
+/**
+ * Bounded buffer of command trace events recorded by modbus and display tasks.
+ */
+class CommandTrace {
+    TraceEvent events[TRACE_BUFFER_SIZE];
+    // index of the next event, never wraps in practice
+    uint32_t nextIndex = 0;
+    portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+
+public:
+    void record(TRACE_EVENT type, uint8_t unit, uint8_t arg, uint16_t value = 0, uint8_t step = 0);
+
+    /**
+     * Returns index of the oldest event still in buffer.
+     */
+    uint32_t getFirstIndex();
+    /**
+     * Returns index after the newest event.
+     */
+    uint32_t getEndIndex();
+    /**
+     * Copies event at index.
+     * @return false if event was already overwritten or not recorded yet
+     */
+    bool get(uint32_t index, TraceEvent& event);
+};
+
+extern CommandTrace commandTrace;
+
+#endif /* F9BD459B_4F43_4B8A_BC89_E3E34510BAB4 */
@@ -2,7 +2,15 @@
 #define ADA51EA7_5CDE_4F82_9082_4C0CF1EBAC39
 
 #include <Arduino.h>
+#include <time.h>
 #include <ModbusIP_ESP8266.h>
+#include "displayFrame.h"
+#include "jitterMeter.h"
+#include "modbusServer.h"
+#include "pipelineCounters.h"
+#include "seqLock.h"
+#include "timeSource.h"
+#include "tuning.h"
 #include "types.h"
 
 #define PIN_DISPLAY_CS GPIO_NUM_5 // conn 4 via 10K
@@ -17,12 +25,67 @@
 #define PIN_KEYBOARD_OUT_COL_2 GPIO_NUM_16 // conn 12 via 1K5
 #define PIN_KEYBOARD_OUT_COL_3 GPIO_NUM_17 // conn 13 via 1K5
 
+// Number of connected heatpump units, second unit is enabled by -DUNIT_COUNT=2 build flag
+#ifndef UNIT_COUNT
+#define UNIT_COUNT 1
+#endif
+
+// Second unit, its display is read by HSPI. CS and keyboard pins must be below GPIO32 for GPIO_FAST_* macros.
+#define PIN_UNIT2_DISPLAY_CS GPIO_NUM_4 // conn 4 via 10K
+#define PIN_UNIT2_DISPLAY_CLK GPIO_NUM_39 // conn 5 via 10K and external pull down
+#define PIN_UNIT2_DISPLAY_DATA GPIO_NUM_36 // conn 3 via 10K and external pull down
+
+#define PIN_UNIT2_KEYBOARD_IN_ROW_1 GPIO_NUM_21 // conn 7
+#define PIN_UNIT2_KEYBOARD_IN_ROW_2 GPIO_NUM_22 // conn 8
+#define PIN_UNIT2_KEYBOARD_IN_ROW_3 GPIO_NUM_19 // conn 9
+
+#define PIN_UNIT2_KEYBOARD_OUT_COL_1 GPIO_NUM_13 // conn 11 via 1K5
+#define PIN_UNIT2_KEYBOARD_OUT_COL_2 GPIO_NUM_14 // conn 12 via 1K5
+#define PIN_UNIT2_KEYBOARD_OUT_COL_3 GPIO_NUM_2 // conn 13 via 1K5
+
+// Modbus RTU server over RS-485, enabled by -DMODBUS_RTU_ENABLED=1 build flag
+#ifndef MODBUS_RTU_ENABLED
+#define MODBUS_RTU_ENABLED 0
+#endif
+#ifndef MODBUS_RTU_BAUD
+#define MODBUS_RTU_BAUD 9600
+#endif
+#ifndef MODBUS_RTU_UNIT_ID
+#define MODBUS_RTU_UNIT_ID 1
+#endif
+#define PIN_MODBUS_RTU_RX GPIO_NUM_34 // RS-485 transceiver RO
+#define PIN_MODBUS_RTU_TX GPIO_NUM_33 // RS-485 transceiver DI
+#define PIN_MODBUS_RTU_DE GPIO_NUM_32 // RS-485 transceiver DE + /RE
+
+// Task layout: display capture, decoding and key sequences run on APP CPU above any other application task,
+// WiFi, lwIP and modbus run on PRO CPU.
+#define DISPLAY_TASK_CORE APP_CPU_NUM
+#define DISPLAY_TASK_PRIORITY 5
+#define DISPLAY_TASK_STACK_SIZE 8192
+#define DISPLAY_TASK_PERIOD_MS 30
+#define NETWORK_TASK_CORE PRO_CPU_NUM
+#define MODBUS_TASK_PRIORITY 2
+#define MODBUS_TASK_STACK_SIZE 4096
+#define MODBUS_RTU_TASK_PRIORITY 2
+#define MODBUS_RTU_TASK_STACK_SIZE 4096
+#define SCHEDULE_TASK_PRIORITY 1
+#define SCHEDULE_TASK_STACK_SIZE 4096
+
+// Time zone of schedule entries in POSIX TZ format and NTP server, can be changed by build flags
+#ifndef SCHEDULE_TZ
+#define SCHEDULE_TZ "CET-1CEST,M3.5.0,M10.5.0/3"
+#endif
+#ifndef NTP_SERVER
+#define NTP_SERVER "pool.ntp.org"
+#endif
+
 // At microsecond speeds, the functions from gpio.h are too heavy
 #define GPIO_FAST_SET_1(gpio_num) GPIO.out_w1ts |= (0x1 << gpio_num)
 #define GPIO_FAST_SET_0(gpio_num) GPIO.out_w1tc |= (0x1 << gpio_num)
 #define GPIO_FAST_OUTPUT_ENABLE(gpio_num) GPIO.enable_w1ts |= (0x1 << gpio_num)
 #define GPIO_FAST_OUTPUT_DISABLE(gpio_num) GPIO.enable_w1tc |= (0x1 << gpio_num)
 #define GPIO_FAST_GET_LEVEL(gpio_num) ((GPIO.in >> gpio_num) & 0x1)
+#define GPIO_FAST_IS_OUTPUT(gpio_num) ((GPIO.enable >> gpio_num) & 0x1)
 
 #define getCsValue() GPIO_FAST_GET_LEVEL(PIN_DISPLAY_CS) // orange
 #define getClkValue() GPIO_FAST_GET_LEVEL(PIN_DISPLAY_CLK) // green
@@ -32,11 +95,30 @@
 #define DEBUG_STR(msg) Serial.printf(__FILE__ ":%d: " msg "\n", __LINE__ )
 #define DEBUG_INT(i) Serial.printf(__FILE__ ":%d: %d\n", __LINE__, i)
 
-extern uint8_t displayBuff[];
-extern ModbusIP modbus;
+extern ModbusIPServer modbus;
+extern JitterMeter displayTaskJitter;
+// number of restarts done by fault recovery, kept in NVS
+extern uint16_t recoveryRestarts;
 
+void initializeWiFi();
+void verifyWiFiConnected();
 void initializeModbus();
-void decodeDisplayData();
+void registerModbusMap(Modbus& mb);
+void applyRegisterValues(Modbus& mb);
+void modbusRtuTask(void* pvParameters);
+void initializeHttp();
+void handleHttp();
+class HeatPumpUnit;
+bool restoreStatus(HeatPumpUnit& unit);
+void restorePressDurations(HeatPumpUnit& unit);
+void restoreTuning();
+void restoreRecoveryRestarts();
+void restoreSchedule(HeatPumpUnit& unit);
+// time of the last schedule check which found due entries
+time_t restoreScheduleCheckTime();
+void persistScheduleCheckTime(time_t time);
+void persistRecoveryRestarts();
+void persistStatus();
 void printData(uint8_t* data, uint8_t bitCount);
 inline const char* boolAsOnOffStr(bool value) {
     return (value) ? "ON" : "OFF";
@@ -44,49 +126,98 @@ inline const char* boolAsOnOffStr(bool value) {
 
 const char* enumToString(MODE value);
 
-#define TEMP_ACCESSORS_IMPL(name, regType, regTypeLowercase) \
-    int8_t get##name() { return (int8_t)(modbus.regType(regTypeLowercase##name) - 128);} \
-    void set##name(int8_t value) { \
-        if (get##name() != value) { Serial.printf("setting " #name ": %d -> %d\n", get##name(), value);} \
-        modbus.regType(regTypeLowercase##name, value + 128); \
+#define TEMP_ACCESSORS(name) \
+    int8_t getTemp##name() { return temps[ts##name]; } \
+    void setTemp##name(int8_t value) { \
+        if (temps[ts##name] != value) { \
+            Serial.printf("setting Temp" #name ": %d -> %d\n", temps[ts##name], value); \
+            temps[ts##name] = value; \
+        } \
+        tempUpdated[ts##name] = timestampNow(); \
+        dirty = true; \
     }
 
-#define TEMP_ACCESSORS_IREG(name) TEMP_ACCESSORS_IMPL(name, Ireg, ireg) 
-#define TEMP_ACCESSORS_HREG(name) TEMP_ACCESSORS_IMPL(name, Hreg, hreg) 
-
 #define FLAG_ACCESSORS(name) \
     void set##name(bool value) {\
         if (value != flag##name) {\
             Serial.printf("set" #name ": %d\n", (int)value);\
+            dirty = true;\
         }\
         flag##name = value;\
     }\
     bool is##name() { return flag##name; } \
     bool flag##name
 
+/**
+ * Returns seconds elapsed since timestamp. Timestamp 0 means never, for it and for too old ones returns UINT16_MAX.
+ */
+inline uint16_t ageSeconds(uint32_t sinceMillis, uint32_t nowMillis) {
+    if (sinceMillis == 0) {
+        // not refresh yet
+        return UINT16_MAX;
+    }
+    uint32_t diffSecs = (nowMillis - sinceMillis) / 1000;
+    return (diffSecs >= UINT16_MAX) ? UINT16_MAX : diffSecs;
+}
 
+/**
+ * Consistent copy of status published by display task for other tasks. All timestamps are in millis, 0 means never.
+ */
+struct StatusSnapshot {
+    MODE mode;
+    /**
+     * Bit mask of STATUS_FLAGS enum values.
+     */
+    uint16_t flags;
+    int8_t temps[TEMP_SENSOR_COUNT];
+    int8_t tempTarget;
+    uint32_t lastRefreshTime;
+    uint32_t tempUpdated[TEMP_SENSOR_COUNT];
+    uint32_t tempTargetUpdated;
+    uint16_t infoValues[INFO_VALUE_COUNT];
+
+    uint16_t getStatusAgeSeconds(uint32_t nowMillis) const {
+        return ageSeconds(lastRefreshTime, nowMillis);
+    }
+};
+
+/**
+ * Status of heatpump. Modified by display task only, other tasks read published StatusSnapshot.
+ */
 class StateData {
     MODE mode = MODE::unknown;
     bool powerOnState = false;
-    ModbusIP& modbus;
     uint32_t currentLoopMillis;
     uint32_t lastRefreshTime = 0;
     int8_t currentSetTempValue;
     int8_t tempTarget = INT8_MIN;
+    int8_t temps[TEMP_SENSOR_COUNT] = { INVALID_TEMP, INVALID_TEMP, INVALID_TEMP, INVALID_TEMP, INVALID_TEMP, INVALID_TEMP };
+    uint32_t tempUpdated[TEMP_SENSOR_COUNT] = {};
+    uint32_t tempTargetUpdated = 0;
+    uint16_t infoValues[INFO_VALUE_COUNT] = {};
+    bool restored = false;
+    bool dirty = true;
+    SeqLock<StatusSnapshot> snapshot;
+
+    uint32_t timestampNow() {
+        // 0 is reserved for never
+        return currentLoopMillis ? currentLoopMillis : 1;
+    }
 
 public:
-    StateData(ModbusIP& modbus) : modbus(modbus) {
+    StateData() : snapshot(StatusSnapshot{ MODE::unknown, 0, {}, INT8_MIN, 0, {}, 0, {} }) {
     }
 
     MODE getDisplayMode() {
-        return (MODE)modbus.Ireg(iregDisplayMode);
+        return mode;
     }
 
     void setDisplayMode(MODE mode) {
-        if (mode != getDisplayMode()) {
+        if (mode != this->mode) {
             Serial.printf("setDisplayMode: %s\n", enumToString(mode));
+            this->mode = mode;
+            dirty = true;
         }
-        modbus.Ireg(iregDisplayMode, mode);
     }
 
     void setCurrentSetTempValue(int8_t value) {
@@ -102,27 +233,56 @@ public:
             Serial.printf("setTempTarget: %d\n", value);
         }
         tempTarget = value;
+        tempTargetUpdated = timestampNow();
+        dirty = true;
     }
 
     int8_t getTempTarget() {
         return tempTarget;
     }
 
+    /**
+     * Sets value of info screen infoCE + index as two characters.
+     */
+    void setInfoValue(uint8_t index, uint16_t value) {
+        if (infoValues[index] != value) {
+            Serial.printf("setInfoValue(%s): %c%c\n", enumToString((MODE)(MODE::infoCE + index)), value >> 8, value & 0xFF);
+            infoValues[index] = value;
+            dirty = true;
+        }
+    }
+
     FLAG_ACCESSORS(PowerOn);
     FLAG_ACCESSORS(Hot);
     FLAG_ACCESSORS(EHeat);
     FLAG_ACCESSORS(Pump);
     FLAG_ACCESSORS(Vacation);
 
-    TEMP_ACCESSORS_IREG(TempT5U);
-    TEMP_ACCESSORS_IREG(TempT5L);
-    TEMP_ACCESSORS_IREG(TempT3);
-    TEMP_ACCESSORS_IREG(TempT4);
-    TEMP_ACCESSORS_IREG(TempTP);
-    TEMP_ACCESSORS_IREG(TempTh);
+    TEMP_ACCESSORS(T5U);
+    TEMP_ACCESSORS(T5L);
+    TEMP_ACCESSORS(T3);
+    TEMP_ACCESSORS(T4);
+    TEMP_ACCESSORS(TP);
+    TEMP_ACCESSORS(Th);
+
+    uint16_t getStatusFlags() {
+        uint16_t res = 0;
+        if (isPowerOn()) res += STATUS_FLAGS::sfPowerOn;
+        if (isHot()) res += STATUS_FLAGS::sfHot;
+        if (isEHeat()) res += STATUS_FLAGS::sfEHeat;
+        if (isPump()) res += STATUS_FLAGS::sfPump;
+        if (isVacation()) res += STATUS_FLAGS::sfVacation;
+        if (restored) res += STATUS_FLAGS::sfRestored;
+        return res;
+    }
+
+    /**
+     * Sets display mode and values shown by decoded frame.
+     */
+    void applyFrame(const DisplayFrame& frame);
 
     void onLoopStart() {
-        currentLoopMillis = (esp_timer_get_time() / 1000ULL);
+        currentLoopMillis = timeSource->millis();
     }
 
     uint32_t getNow() {
@@ -130,7 +290,23 @@ public:
     }
 
     void onStatusUpdated() {
-        lastRefreshTime = millis();
+        lastRefreshTime = timeSource->millis();
+        restored = false;
+        dirty = true;
+    }
+
+    /**
+     * Sets status saved before restart. Called before display task starts.
+     */
+    void restore(const StatusSnapshot& status) {
+        setPowerOn(status.flags & STATUS_FLAGS::sfPowerOn);
+        tempTarget = status.tempTarget;
+        tempTargetUpdated = status.tempTargetUpdated;
+        memcpy(temps, status.temps, sizeof(temps));
+        memcpy(tempUpdated, status.tempUpdated, sizeof(tempUpdated));
+        lastRefreshTime = status.lastRefreshTime;
+        restored = true;
+        dirty = true;
     }
 
     uint32_t millisSince(uint32_t sinceMillis) {
@@ -141,18 +317,34 @@ public:
         }
     }
 
-    uint16_t getStatusAgeSeconds() {
-        if (lastRefreshTime == 0) {
-            // not refresh yet
-            return UINT16_MAX;
+    /**
+     * Publishes changed status to other tasks. Called by display task only.
+     */
+    void publish() {
+        if (!dirty) {
+            return;
         }
-        uint32_t diffSecs = millisSince(lastRefreshTime) / 1000;
-        return (diffSecs >= UINT16_MAX) ? UINT16_MAX : diffSecs;
+        dirty = false;
+        StatusSnapshot status;
+        status.mode = mode;
+        status.flags = getStatusFlags();
+        memcpy(status.temps, temps, sizeof(temps));
+        status.tempTarget = tempTarget;
+        status.lastRefreshTime = lastRefreshTime;
+        memcpy(status.tempUpdated, tempUpdated, sizeof(tempUpdated));
+        status.tempTargetUpdated = tempTargetUpdated;
+        memcpy(status.infoValues, infoValues, sizeof(infoValues));
+        snapshot.write(status);
+    }
+
+    /**
+     * Returns last published status, safe to be called from any task.
+     */
+    StatusSnapshot getSnapshot() {
+        return snapshot.read();
     }
 };
 
 #undef TEMP_ACCESSORS
 
-extern StateData stateData;
-
 #endif /* ADA51EA7_5CDE_4F82_9082_4C0CF1EBAC39 */
@@ -0,0 +1,66 @@
+#ifndef D52B8F47_A1E6_4C93_8B0D_7E3F2A6C19D4
+#define D52B8F47_A1E6_4C93_8B0D_7E3F2A6C19D4
+
+#include <cstdint>
+#include "types.h"
+
+#define DISPLAY_FRAME_SIZE 16
+
+/**
+ * Number of info screens with diagnostic values, infoCE to infoD7F.
+ */
+#define INFO_VALUE_COUNT 5
+
+/**
+ * Icons of display decoded to DisplayFrame::icons.
+ */
+enum DISPLAY_ICON {
+    diLocked = 1 << 0,
+    diSetClock = 1 << 1,
+    diSetTemp = 1 << 2,
+    diSetVacation = 1 << 3,
+    diHot = 1 << 4,
+    diEHeat = 1 << 5,
+    diPump = 1 << 6,
+    diVacation = 1 << 7
+};
+
+/**
+ * Content of one display frame decoded in one pass.
+ */
+struct DisplayFrame {
+    MODE mode;
+    /**
+     * Bit mask of DISPLAY_ICON values.
+     */
+    uint16_t icons;
+    /**
+     * Value digit group (temperature, set value or diagnostic value), tens first. Unknown segment combination is 0.
+     */
+    char valueDigits[2];
+    /**
+     * Info label digit group, left to right. Unknown segment combination (e.g. letter) is 0.
+     */
+    char labelDigits[3];
+    /**
+     * Number shown by value digits or INVALID_TEMP.
+     */
+    int8_t value;
+    /**
+     * Number of undecodable value digits on screens which show a temperature.
+     */
+    uint8_t bcdErrors;
+    /**
+     * Label digits match neither info screen nor plain digits.
+     */
+    bool unknownLabel;
+    uint8_t raw[DISPLAY_FRAME_SIZE];
+};
+
+char segmentsToChar(uint8_t c);
+int8_t digitsToNumber(const char* digits);
+void realignFrame(uint8_t* data);
+void decodeFrame(const uint8_t* data, DisplayFrame& frame);
+uint16_t valueDigitsAsRegister(const DisplayFrame& frame);
+
+#endif /* D52B8F47_A1E6_4C93_8B0D_7E3F2A6C19D4 */
@@ -0,0 +1,137 @@
+#ifndef E76E4AB1_8E74_43F6_A7D0_AE63CDF5D88E
+#define E76E4AB1_8E74_43F6_A7D0_AE63CDF5D88E
+
+#include <algorithm>
+#include <cstdint>
+#include "seqLock.h"
+
+// rolling windows of duty cycle, 1 h in minute buckets and 24 h in 15 minute buckets
+#define DUTY_SHORT_WINDOW_MS (60 * 60 * 1000UL)
+#define DUTY_SHORT_BUCKETS 60
+#define DUTY_LONG_WINDOW_MS (24 * 60 * 60 * 1000UL)
+#define DUTY_LONG_BUCKETS 96
+
+/**
+ * Min time between two publications of statistics, transitions are published immediately.
+ */
+#define DUTY_PUBLISH_PERIOD_MS 1000
+
+/**
+ * Heating flags with statistics, in order of iregDuty* register blocks.
+ */
+enum DUTY_FLAG {
+    dfHot = 0,
+    dfEHeat,
+    dfPump,
+    DUTY_FLAG_COUNT
+};
+
+/**
+ * On-time of a flag over rolling window split to N buckets. Bucket leaving the window is dropped as a whole.
+ */
+template <uint8_t N>
+class RollingOnTime {
+    const uint32_t bucketMs;
+    uint32_t onMs[N] = {};
+    uint32_t sumMs = 0;
+    // absolute index of the newest bucket
+    uint64_t currentBucket = 0;
+
+    void moveTo(uint64_t bucket) {
+        for (uint64_t b = currentBucket + 1; b <= bucket && b <= currentBucket + N; b++) {
+            sumMs -= onMs[b % N];
+            onMs[b % N] = 0;
+        }
+        if (bucket > currentBucket) {
+            currentBucket = bucket;
+        }
+    }
+
+public:
+    RollingOnTime(uint32_t windowMs) : bucketMs(windowMs / N) {
+    }
+
+    /**
+     * Adds interval of elapsed time starting startMs after start of statistics.
+     */
+    void add(uint64_t startMs, uint32_t lengthMs, bool on) {
+        while (lengthMs) {
+            uint64_t bucket = startMs / bucketMs;
+            moveTo(bucket);
+            uint32_t chunk = (uint32_t)std::min<uint64_t>(lengthMs, (bucket + 1) * bucketMs - startMs);
+            if (on) {
+                onMs[bucket % N] += chunk;
+                sumMs += chunk;
+            }
+            startMs += chunk;
+            lengthMs -= chunk;
+        }
+    }
+
+    /**
+     * Returns duty cycle in 0.01 % over the window ending at elapsedMs, or over elapsedMs if it is shorter.
+     */
+    uint16_t getDuty(uint64_t elapsedMs) {
+        // window starts at the oldest bucket still kept
+        uint64_t windowStartMs = (currentBucket >= N) ? (currentBucket - N + 1) * bucketMs : 0;
+        uint64_t coveredMs = elapsedMs - windowStartMs;
+        return coveredMs ? (uint64_t)sumMs * 10000 / coveredMs : 0;
+    }
+};
+
+/**
+ * Statistics of one flag. Timestamps are in millis, 0 means never.
+ */
+struct FlagStats {
+    bool on;
+    uint32_t lastOnMillis;
+    uint32_t lastOffMillis;
+    uint32_t onSeconds;
+    uint32_t cycles;
+    // duty cycle in 0.01 %
+    uint16_t dutyShort;
+    uint16_t dutyLong;
+};
+
+struct DutySnapshot {
+    FlagStats flags[DUTY_FLAG_COUNT];
+};
+
+/**
+ * Incremental on-time, cycle and duty cycle statistics of heating flags decoded from display frames. Flags are
+ * visible in locked and unlocked mode only, last seen state is assumed meanwhile. Updated by display task, other
+ * tasks read published DutySnapshot.
+ */
+class DutyStats {
+    bool started = false;
+    uint32_t lastUpdateMillis = 0;
+    uint32_t lastPublishMillis = 0;
+    uint64_t elapsedMs = 0;
+    uint32_t onMsRemainder[DUTY_FLAG_COUNT] = {};
+    FlagStats flags[DUTY_FLAG_COUNT] = {};
+    RollingOnTime<DUTY_SHORT_BUCKETS> shortWindows[DUTY_FLAG_COUNT] = { DUTY_SHORT_WINDOW_MS, DUTY_SHORT_WINDOW_MS, DUTY_SHORT_WINDOW_MS };
+    RollingOnTime<DUTY_LONG_BUCKETS> longWindows[DUTY_FLAG_COUNT] = { DUTY_LONG_WINDOW_MS, DUTY_LONG_WINDOW_MS, DUTY_LONG_WINDOW_MS };
+    SeqLock<DutySnapshot> snapshot;
+
+    void publish(uint32_t nowMillis);
+
+public:
+    DutyStats() : snapshot(DutySnapshot{}) {
+    }
+
+    /**
+     * Accounts time since last update to current state of flags. Called by display task in every loop.
+     */
+    void update(uint32_t nowMillis);
+    /**
+     * Applies flags of a frame showing them.
+     * @param icons bit mask of DISPLAY_ICON values
+     */
+    void observe(uint16_t icons, uint32_t nowMillis);
+
+    DutySnapshot getSnapshot() {
+        return snapshot.read();
+    }
+};
+
+#endif /* E76E4AB1_8E74_43F6_A7D0_AE63CDF5D88E */
@@ -0,0 +1,83 @@
+#ifndef A91F3C62_0D7B_4E58_B3A4_6C2E8F1D5B07
+#define A91F3C62_0D7B_4E58_B3A4_6C2E8F1D5B07
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Writes text to a caller provided buffer without any heap allocation. Output exceeding the buffer is dropped
+ * and reported by isOverflow(), the buffer is always null terminated.
+ */
+class FixedWriter {
+    char* buffer;
+    size_t size;
+    size_t length = 0;
+    bool overflow = false;
+
+public:
+    FixedWriter(char* buffer, size_t size) : buffer(buffer), size(size) {
+        buffer[0] = '\0';
+    }
+
+    FixedWriter& write(char c) {
+        if (length + 1 < size) {
+            buffer[length++] = c;
+            buffer[length] = '\0';
+        } else {
+            overflow = true;
+        }
+        return *this;
+    }
+
+    FixedWriter& write(const char* str) {
+        while (*str) {
+            write(*str++);
+        }
+        return *this;
+    }
+
+    FixedWriter& writeUint(uint32_t value) {
+        char digits[10];
+        int count = 0;
+        do {
+            digits[count++] = '0' + value % 10;
+            value /= 10;
+        } while (value);
+        while (count) {
+            write(digits[--count]);
+        }
+        return *this;
+    }
+
+    FixedWriter& writeInt(int32_t value) {
+        if (value < 0) {
+            write('-');
+            return writeUint(-(int64_t)value);
+        }
+        return writeUint(value);
+    }
+
+    FixedWriter& writeBool(bool value) {
+        return write(value ? "true" : "false");
+    }
+
+    const char* getBuffer() {
+        return buffer;
+    }
+
+    size_t getLength() {
+        return length;
+    }
+
+    bool isOverflow() {
+        return overflow;
+    }
+
+    void clear() {
+        length = 0;
+        overflow = false;
+        buffer[0] = '\0';
+    }
+};
+
+#endif /* A91F3C62_0D7B_4E58_B3A4_6C2E8F1D5B07 */
@@ -0,0 +1,120 @@
+#ifndef A4EECA31_6BE9_4AE6_896B_11CAF5C2A815
+#define A4EECA31_6BE9_4AE6_896B_11CAF5C2A815
+
+#include <Arduino.h>
+#include <driver/spi_slave.h>
+#include "busProfiler.h"
+#include "common.h"
+#include "dutyStats.h"
+#include "keySequences.h"
+#include "schedule.h"
+
+/**
+ * Number of display bus faults in a row after which SPI slave is re-initialised.
+ */
+#define RECOVERY_FAULTS_BEFORE_REINIT 5
+
+/**
+ * Number of re-initialisations without a good frame in between after which the device is restarted.
+ */
+#define RECOVERY_REINITS_BEFORE_RESTART 3
+
+/**
+ * Min uptime before fault recovery may restart the device, faults of earlier run are handled by re-initialisation.
+ */
+#define RECOVERY_MIN_UPTIME_MS (10 * 60 * 1000UL)
+
+/**
+ * Max number of restarts of one unit without a good frame in between. When it is reached, recovery stays on
+ * re-initialisation of SPI slave until the display sends a good frame.
+ */
+#define RECOVERY_MAX_RESTARTS_WITHOUT_FRAME 3
+
+/**
+ * Display bus and keyboard pins of one heatpump unit.
+ */
+struct UnitPins {
+    spi_host_device_t spiHost;
+    gpio_num_t displayCs;
+    gpio_num_t displayClk;
+    gpio_num_t displayData;
+    KeyboardPins keyboard;
+};
+
+/**
+ * One connected heatpump: its display bus, keyboard, status and key sequences. Display and keyboard are handled
+ * by display task, other tasks use published status of stateData and keyboardSequence.processKeySequence() only.
+ */
+class HeatPumpUnit {
+    const uint8_t index;
+    const UnitPins& pins;
+
+    WORD_ALIGNED_ATTR uint8_t displayBuff[32];
+    spi_slave_transaction_t spiReadTransaction;
+    volatile bool displayDataReady = false;
+    volatile bool spiTransactionStared = false;
+    uint32_t lastTransactionStartedMillis = 0;
+    uint32_t frameCountAtTransactionStart = 0;
+    bool bootRefreshPending = false;
+
+    // fault recovery, all counters are cleared by a good frame
+    volatile uint16_t faultsInRow = 0;
+    uint8_t reinitsWithoutFrame = 0;
+    // kept in NVS over restarts
+    uint8_t restartsWithoutFrame = 0;
+
+public:
+    StateData stateData;
+    Keyboard keyboard;
+    KeyboardSequence keyboardSequence;
+    PipelineCounters pipelineCounters;
+    BusProfiler busProfiler;
+    DutyStats dutyStats;
+    Schedule schedule;
+
+    HeatPumpUnit(uint8_t index, const UnitPins& pins);
+
+    uint8_t getIndex() {
+        return index;
+    }
+
+    void setBootRefreshPending(bool pending) {
+        bootRefreshPending = pending;
+    }
+
+    uint16_t getFaultsInRow() {
+        return faultsInRow;
+    }
+
+    uint8_t getRestartsWithoutFrame() {
+        return restartsWithoutFrame;
+    }
+
+    void setRestartsWithoutFrame(uint8_t restarts) {
+        restartsWithoutFrame = restarts;
+    }
+
+    /**
+     * Configures keyboard pins. Called from setup before tasks start.
+     */
+    void initializePins();
+    /**
+     * Attaches keyboard interrupt and starts display bus. Called by display task, so interrupts are served by its core.
+     */
+    void initializeDisplay();
+    void displayLoop();
+
+private:
+    void startDisplayBus();
+    void onBusFault();
+    bool handleDisplayDataReady();
+    void decodeDisplayData();
+
+    static void keyboardPulseInt(void* arg);
+    static void displayCsInt(void* arg);
+    static void displayDataReceived(spi_slave_transaction_t* t);
+};
+
+extern HeatPumpUnit units[UNIT_COUNT];
+
+#endif /* A4EECA31_6BE9_4AE6_896B_11CAF5C2A815 */
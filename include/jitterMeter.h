@@ -0,0 +1,89 @@
+#ifndef B4D07E21_8C3A_4A6F_9E15_F2A6C0D8E937
+#define B4D07E21_8C3A_4A6F_9E15_F2A6C0D8E937
+
+#include <Arduino.h>
+
+/**
+ * Length of window over which jitter statistics are aggregated before being published.
+ */
+#define JITTER_WINDOW_MS 10000
+
+/**
+ * Measures jitter of a periodic task, i.e. deviation of time between two wake ups from nominal period,
+ * and time spent in one iteration. Updated by the measured task, results can be read from any task.
+ */
+class JitterMeter {
+    uint32_t nominalPeriodUs;
+    int64_t lastWakeUs = 0;
+    int64_t windowStartUs = 0;
+    uint32_t windowJitterMaxUs = 0;
+    uint32_t windowJitterSumUs = 0;
+    uint32_t windowCount = 0;
+    uint32_t windowBusyMaxUs = 0;
+
+    // results of last complete window
+    volatile uint32_t jitterMaxUs = 0;
+    volatile uint32_t jitterAvgUs = 0;
+    volatile uint32_t busyMaxUs = 0;
+    volatile uint32_t jitterMaxEverUs = 0;
+
+public:
+    JitterMeter(uint32_t nominalPeriodMs) : nominalPeriodUs(nominalPeriodMs * 1000) {
+    }
+
+    /**
+     * Changes nominal period, called by the measured task.
+     */
+    void setNominalPeriodMs(uint32_t nominalPeriodMs) {
+        nominalPeriodUs = nominalPeriodMs * 1000;
+    }
+
+    void onWake() {
+        int64_t now = esp_timer_get_time();
+        if (lastWakeUs) {
+            int64_t period = now - lastWakeUs;
+            uint32_t jitter = (period > nominalPeriodUs) ? period - nominalPeriodUs : nominalPeriodUs - period;
+            if (jitter > windowJitterMaxUs) {
+                windowJitterMaxUs = jitter;
+            }
+            windowJitterSumUs += jitter;
+            windowCount++;
+        } else {
+            windowStartUs = now;
+        }
+        lastWakeUs = now;
+
+        if (now - windowStartUs >= JITTER_WINDOW_MS * 1000LL && windowCount) {
+            jitterMaxUs = windowJitterMaxUs;
+            jitterAvgUs = windowJitterSumUs / windowCount;
+            busyMaxUs = windowBusyMaxUs;
+            if (windowJitterMaxUs > jitterMaxEverUs) {
+                jitterMaxEverUs = windowJitterMaxUs;
+            }
+            windowStartUs = now;
+            windowJitterMaxUs = windowJitterSumUs = windowCount = windowBusyMaxUs = 0;
+        }
+    }
+
+    void onIterationDone() {
+        uint32_t busy = esp_timer_get_time() - lastWakeUs;
+        if (busy > windowBusyMaxUs) {
+            windowBusyMaxUs = busy;
+        }
+    }
+
+    uint32_t getJitterMaxUs() {
+        return jitterMaxUs;
+    }
+    uint32_t getJitterAvgUs() {
+        return jitterAvgUs;
+    }
+    uint32_t getBusyMaxUs() {
+        return busyMaxUs;
+    }
+    uint32_t getJitterMaxEverUs() {
+        return jitterMaxEverUs;
+    }
+};
+
+#endif /* B4D07E21_8C3A_4A6F_9E15_F2A6C0D8E937 */
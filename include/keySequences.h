@@ -1,46 +1,248 @@
 #ifndef D9F5614E_AB7E_4715_9792_44B8B371911D
 #define D9F5614E_AB7E_4715_9792_44B8B371911D
 
+#include <atomic>
 #include <cstdint>
 #include "keyboard.h"
 
+/**
+ * Max number of steps of any key sequence, size of per-step statistics.
+ */
+#define SEQUENCE_MAX_STEPS 16
+
+/**
+ * Max number of recovery attempts within one run of a key sequence.
+ */
+#define SEQUENCE_MAX_RETRIES 3
+
+/**
+ * Number of successful presses required to accept duration during calibration.
+ */
+#define CALIBRATION_TRIALS 3
+
+/**
+ * Max time to wait for display to lock itself before unlock calibration is skipped.
+ */
+#define CALIBRATION_LOCK_WAIT_MS (5 * 60 * 1000UL)
+
+/**
+ * Max number of presses in a row which do not reach the planned mode before navigation fails. Length of the path
+ * is not limited, each press confirmed by display resets the count.
+ */
+#define NAVIGATION_MAX_PRESSES 3
+
 enum KEY_SEQUENCE {
     ksNone = 0,
     ksRefreshStatus,
     ksPowerOn,
-    ksSetTargetTemp
+    ksSetTargetTemp,
+    ksPressKey,
+    ksCalibrate,
+    ksRefreshValue
+};
+
+/**
+ * Index of value refreshed by ksRefreshValue following TEMP_SENSOR indexes.
+ */
+#define REFRESH_VALUE_TEMP_TARGET TEMP_SENSOR_COUNT
+#define REFRESH_VALUE_COUNT (REFRESH_VALUE_TEMP_TARGET + 1)
+
+/**
+ * Key presses used by sequences, their durations are calibrated.
+ */
+enum PRESS_ACTION {
+    // short press of any key
+    paTap = 0,
+    // hold of keyEHeaterPlusDisinfect to enter and leave info screens
+    paInfoToggle,
+    // hold of keyEnter to unlock display
+    paUnlock,
+    PRESS_ACTION_COUNT
+};
+
+/**
+ * Calibration of one press action: key is pressed in fromMode and display is expected to switch to toMode.
+ */
+struct PressCalibration {
+    KEYS key;
+    MODE fromMode;
+    MODE toMode;
+    // press returning display from toMode to fromMode, locked display locks itself
+    KEYS backKey;
+    PRESS_ACTION backAction;
+    uint16_t defaultMs;
+    uint16_t resolutionMs;
+    // range of durations which can be set manually
+    uint16_t minMs;
+    uint16_t maxMs;
+};
+
+extern const PressCalibration pressCalibrations[PRESS_ACTION_COUNT];
+
+/**
+ * Result of one step of navigation to a target mode.
+ */
+enum NAVIGATION_RESULT {
+    nrArrived = 0,
+    nrMoving,
+    // target is not reachable from current mode or too many presses were needed
+    nrFailed
+};
+
+/**
+ * State of key sequence request handed over from other tasks to display task.
+ */
+enum COMMAND_STATE : uint8_t {
+    csIdle = 0,
+    csClaimed,
+    csPosted,
+    csRunning,
+    csDone
 };
 
-extern Keyboard keyboard;
+const char* enumToString(KEY_SEQUENCE value);
 
 class KeyboardSequence {
+    const uint8_t unitIndex;
     Keyboard& keyboard;
+    StateData& stateData;
 
     KEY_SEQUENCE currentSequence = KEY_SEQUENCE::ksNone;
     uint16_t currentSequenceTargetValue;
     uint8_t currentSequenceStep = 0;
     unsigned long displayReadsAfterKeyUp = 0;
 
+    // recovery state of current sequence run
+    bool stepCheckFailed = false;
+    uint8_t retriesLeft = 0;
+    MODE verifiedStepModes[SEQUENCE_MAX_STEPS];
+    uint8_t navigationPresses = 0;
+    MODE navigationExpectedMode = MODE::unknown;
+
+    // per step statistics: successful re-synchronisations and sequences cancelled after retry budget was used
+    uint16_t stepRetryCount[SEQUENCE_MAX_STEPS] = {};
+    uint16_t stepAbortCount[SEQUENCE_MAX_STEPS] = {};
+
+    // single slot command handoff, requester owns command fields in csClaimed, display task in csPosted and csRunning
+    std::atomic<uint8_t> commandState{ COMMAND_STATE::csIdle };
+    std::atomic<bool> commandAbandoned{ false };
+    KEY_SEQUENCE commandSequence = KEY_SEQUENCE::ksNone;
+    uint16_t commandTargetValue = 0;
+    bool commandResult = false;
+
+    // press durations in ms, written by display task only
+    std::atomic<uint16_t> pressDurations[PRESS_ACTION_COUNT];
+    std::atomic<bool> pressDurationsChanged{ false };
+    std::atomic<bool> calibrationRequested{ false };
+    // bit mask of values to be refreshed in background, bit index is TEMP_SENSOR or REFRESH_VALUE_TEMP_TARGET
+    std::atomic<uint8_t> refreshRequests{ 0 };
+    // values whose last background refresh failed and time of the failure, requests are ignored for a while after it
+    std::atomic<uint8_t> refreshFailures{ 0 };
+    std::atomic<uint32_t> refreshFailedMillis[REFRESH_VALUE_COUNT] = {};
+
+    // binary search of current calibration run, low fails, high works
+    PRESS_ACTION calibratedAction;
+    uint16_t calibrationLowMs;
+    uint16_t calibrationHighMs;
+    uint16_t calibrationTrialMs;
+    uint8_t calibrationSuccesses;
+    uint16_t calibrationFlagsBefore;
+    uint8_t calibrationReverts;
+    uint32_t calibrationWaitStartMillis;
+
 public:
-    KeyboardSequence(Keyboard& keyboard) : keyboard(keyboard) {}
+    KeyboardSequence(uint8_t unitIndex, Keyboard& keyboard, StateData& stateData);
 
     KEY_SEQUENCE getCurrentSequence() { return currentSequence; }
 
     bool onLoop();
+    /**
+     * Starts requested calibration if no other sequence runs. Called by display task only.
+     */
+    void startRequestedCalibration();
+    /**
+     * Starts refresh of the first requested value if no other sequence runs. Called by display task only.
+     */
+    void startRequestedRefresh();
     void afterDisplayDataRead() {
         displayReadsAfterKeyUp++;
     }
 
     bool startKeySequence(KEY_SEQUENCE sequence, uint16_t targetValue);
+    /**
+     * Hands sequence over to display task and waits for its completion. Can be called from any task except display task.
+     * @return true if sequence was completed in time
+     */
     bool processKeySequence(KEY_SEQUENCE sequence, uint16_t targetValue, uint16_t timeoutMs);
     void cancelCurrentSequence();
 
+    uint16_t getPressDuration(PRESS_ACTION action) {
+        return pressDurations[action];
+    }
+    /**
+     * Sets durations restored from flash. Called before display task starts.
+     */
+    void setPressDurations(const uint16_t* durations);
+    /**
+     * Sets duration of press action if it is within its allowed range.
+     * @return false if duration is out of range
+     */
+    bool setPressDuration(PRESS_ACTION action, uint16_t durationMs);
+    /**
+     * Returns true once after calibration has changed durations, so they can be saved.
+     */
+    bool takePressDurationsChanged() {
+        return pressDurationsChanged.exchange(false);
+    }
+    /**
+     * Requests calibration of press durations, it is started by display task when no other sequence runs.
+     */
+    void requestCalibration() {
+        calibrationRequested = true;
+    }
+    /**
+     * Returns true from calibration request until calibration is finished.
+     */
+    bool isCalibrating() {
+        return calibrationRequested;
+    }
+    /**
+     * Requests background refresh of one value, requests of the same value are merged until it is refreshed.
+     * Requests are ignored for hregTuneStaleReadS after failed refresh of the value, so stale reads don't press keys
+     * continuously while the display can't show it.
+     * @param index TEMP_SENSOR or REFRESH_VALUE_TEMP_TARGET
+     */
+    void requestValueRefresh(uint8_t index);
+
+    uint16_t getStepRetryCount(uint8_t step) {
+        return (step < SEQUENCE_MAX_STEPS) ? stepRetryCount[step] : 0;
+    }
+    uint16_t getStepAbortCount(uint8_t step) {
+        return (step < SEQUENCE_MAX_STEPS) ? stepAbortCount[step] : 0;
+    }
+
 private:
-    bool checkDisplayModeAndDoNextStep(MODE expMode, KEYS key, uint16_t durationMs);
+    bool checkDisplayMode(MODE expMode);
+    bool tryResumeSequence();
+    void processCommand();
+    void finishCommand(bool result);
+    void releaseAbandonedCommand();
+    bool checkDisplayModeAndDoNextStep(MODE expMode, KEYS key, PRESS_ACTION action);
+    NAVIGATION_RESULT navigateTo(MODE targetMode);
     bool commonGetStateSteps0to3();
     bool keySequencePowerOn(bool targetPowerOnValue);
     bool keySequenceSetTargetTemp(int8_t targetTemp);
     bool keySequenceRefreshStatus();
+    bool readTempTargetSteps(uint8_t firstStep);
+    bool keySequenceRefreshValue(uint8_t index);
+    bool keySequencePressKey(uint16_t keyAndDuration);
+    bool keySequenceCalibrate();
+    void startActionCalibration(PRESS_ACTION action);
+    bool onCalibrationTrialDone(bool success);
+    bool finishActionCalibration();
+    void pressKey(KEYS key, PRESS_ACTION action) {
+        keyboard.keyDown(key, pressDurations[action]);
+    }
 };
 
 #endif /* D9F5614E_AB7E_4715_9792_44B8B371911D */
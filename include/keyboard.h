@@ -4,20 +4,33 @@
 #include <cstdint>
 #include "common.h"
 
+/**
+ * Pins of keyboard matrix of one heatpump unit.
+ */
+struct KeyboardPins {
+    gpio_num_t inRows[3];
+    gpio_num_t outCols[3];
+};
+
 class Keyboard {
 public:
-    Keyboard();
+    Keyboard(uint8_t unitIndex, StateData& stateData, const KeyboardPins& pins);
 
 private:
+    const uint8_t unitIndex;
+    StateData& stateData;
+    const KeyboardPins& pins;
+
     uint32_t keyDownAtMillis = 0;
     uint32_t keyDownDurationMillis = 0;
 
     uint8_t outPin = 0;
     uint8_t inRow = 0;
+    KEYS keyDownKey;
 
 public:
     void inline onKeyboardInputRow1Low() {
-        if (!isKeyDown() || GPIO_FAST_GET_LEVEL(PIN_KEYBOARD_IN_ROW_1)) {
+        if (!isKeyDown() || GPIO_FAST_GET_LEVEL(pins.inRows[0])) {
             // delayed interrupt processing, ignore
             return;
         }
@@ -25,38 +38,44 @@ public:
         case 0:
             // row 1
             GPIO_FAST_SET_0(outPin);
-            while (!GPIO_FAST_GET_LEVEL(PIN_KEYBOARD_IN_ROW_1)) NOP();
+            while (!GPIO_FAST_GET_LEVEL(pins.inRows[0])) NOP();
             GPIO_FAST_SET_1(outPin);
             break;
         case 1:
             // row 2
-            while (GPIO_FAST_GET_LEVEL(PIN_KEYBOARD_IN_ROW_2)) NOP();
+            while (GPIO_FAST_GET_LEVEL(pins.inRows[1])) NOP();
             GPIO_FAST_SET_0(outPin);
-            while (!GPIO_FAST_GET_LEVEL(PIN_KEYBOARD_IN_ROW_2)) NOP();
+            while (!GPIO_FAST_GET_LEVEL(pins.inRows[1])) NOP();
             GPIO_FAST_SET_1(outPin);
             break;
         case 2:
             // row 3
-            while (!GPIO_FAST_GET_LEVEL(PIN_KEYBOARD_IN_ROW_3)) NOP();
+            while (!GPIO_FAST_GET_LEVEL(pins.inRows[2])) NOP();
             GPIO_FAST_SET_1(outPin);
-            while (GPIO_FAST_GET_LEVEL(PIN_KEYBOARD_IN_ROW_3)) NOP();
+            while (GPIO_FAST_GET_LEVEL(pins.inRows[2])) NOP();
             GPIO_FAST_SET_0(outPin);
             break;
         case 3:
-            while (!GPIO_FAST_GET_LEVEL(PIN_KEYBOARD_IN_ROW_3) || !GPIO_FAST_GET_LEVEL(PIN_KEYBOARD_IN_ROW_1)) NOP();
+            while (!GPIO_FAST_GET_LEVEL(pins.inRows[2]) || !GPIO_FAST_GET_LEVEL(pins.inRows[0])) NOP();
             GPIO_FAST_SET_1(outPin);
-            while (GPIO_FAST_GET_LEVEL(PIN_KEYBOARD_IN_ROW_3)) NOP();
+            while (GPIO_FAST_GET_LEVEL(pins.inRows[2])) NOP();
             GPIO_FAST_SET_0(outPin);
             break;
         }
     }
 
+    void initializePins();
     void onLoop();
     void keyDown(KEYS key, uint16_t durationMs);
     bool isKeyDown() {
         return keyDownDurationMillis != 0;
     }
     void setKeyboardOutPinsAsInputs();
+    /**
+     * Resets column pins to inputs if any of them is driven as output while no key is pressed.
+     * @return true if a stuck pin was found
+     */
+    bool resetStuckOutPins();
 
     uint32_t getKeyDownDurationMillis() {
         return keyDownDurationMillis;
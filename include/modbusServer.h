@@ -0,0 +1,53 @@
+#ifndef C3E1B0A4_6F2D_4B8E_9A57_2D94E1F0B6C8
+#define C3E1B0A4_6F2D_4B8E_9A57_2D94E1F0B6C8
+
+#include <ModbusIP_ESP8266.h>
+
+/**
+ * Max time in ms the modbus task sleeps when no client has sent a request. New client connections
+ * are accepted at latest after this time, requests of connected clients wake the task immediately.
+ */
+#ifndef MODBUS_TASK_IDLE_MS
+#define MODBUS_TASK_IDLE_MS 20
+#endif
+
+/**
+ * Max number of serving rounds per wake up. Each round serves pending requests of all clients in turn.
+ */
+#ifndef MODBUS_SERVE_MAX_ROUNDS
+#define MODBUS_SERVE_MAX_ROUNDS 8
+#endif
+
+/**
+ * Modbus TCP server woken by readiness of client sockets instead of fixed polling period.
+ *
+ * Max number of clients is given by MODBUSIP_MAX_CLIENTS and time slice of one client in a serving round
+ * by MODBUSIP_MAX_READMS build flags of modbus library.
+ */
+class ModbusIPServer : public ModbusIP {
+public:
+    /**
+     * Blocks until any connected client has a request to read or timeout expires.
+     * @return true if there is a request to serve
+     */
+    bool waitForRequest(uint32_t timeoutMs);
+
+    /**
+     * Serves clients round robin until there is no pending request or MODBUS_SERVE_MAX_ROUNDS is reached.
+     */
+    void serve();
+
+    /**
+     * Sets callback invoked before each serving round.
+     */
+    void onBeforeServe(void (*callback)()) {
+        beforeServeCallback = callback;
+    }
+
+private:
+    void (*beforeServeCallback)() = nullptr;
+
+    bool hasPendingRequest();
+};
+
+#endif /* C3E1B0A4_6F2D_4B8E_9A57_2D94E1F0B6C8 */
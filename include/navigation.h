@@ -0,0 +1,29 @@
+#ifndef E4AC53CF_FD64_4124_8C72_B6067431DF2E
+#define E4AC53CF_FD64_4124_8C72_B6067431DF2E
+
+#include <cstdint>
+#include "keySequences.h"
+
+#define MODE_COUNT (MODE::vacation + 1)
+
+/**
+ * Transition of panel UI: pressing key in mode "from" switches display to mode "to".
+ */
+struct NavigationEdge {
+    MODE from;
+    KEYS key;
+    PRESS_ACTION action;
+    MODE to;
+};
+
+extern const NavigationEdge navigationEdges[];
+extern const uint8_t navigationEdgeCount;
+
+/**
+ * Finds the cheapest path from one mode to another one. Cost of an edge is cost of its press action.
+ * @param actionCosts cost of each press action, indexed by PRESS_ACTION
+ * @return the first edge of the path, nullptr if modes are the same or there is no path
+ */
+const NavigationEdge* planNextEdge(MODE from, MODE to, const uint32_t* actionCosts);
+
+#endif /* E4AC53CF_FD64_4124_8C72_B6067431DF2E */
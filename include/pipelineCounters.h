@@ -0,0 +1,58 @@
+#ifndef F0C4A8E3_5B19_4D27_A6E2_91D3B7F5C048
+#define F0C4A8E3_5B19_4D27_A6E2_91D3B7F5C048
+
+#include <atomic>
+#include <cstdint>
+#include <freertos/FreeRTOS.h>
+
+/**
+ * Events of display capture and decoding pipeline.
+ */
+enum PIPELINE_COUNTER {
+    pcFramesReceived = 0,
+    pcFramesBad,
+    pcSpiTimeouts,
+    pcQueueFailures,
+    pcResultFailures,
+    pcBcdErrors,
+    pcUnknownTd,
+    pcSpiReinits,
+    pcKeyboardResets,
+    PIPELINE_COUNTER_COUNT
+};
+
+/**
+ * Free running 32-bit event counters incremented by display task. Reset only moves baseline of readers,
+ * so reported values stay correct across wraparound and counters are never written by two tasks. Baseline
+ * is guarded because TCP and RTU modbus tasks can reset it at the same time.
+ */
+class PipelineCounters {
+    std::atomic<uint32_t> counters[PIPELINE_COUNTER_COUNT] = {};
+    uint32_t baseline[PIPELINE_COUNTER_COUNT] = {};
+    portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+
+public:
+    void increment(PIPELINE_COUNTER counter) {
+        counters[counter].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * Returns number of events since last reset.
+     */
+    uint32_t get(PIPELINE_COUNTER counter) {
+        portENTER_CRITICAL(&mux);
+        uint32_t value = counters[counter].load(std::memory_order_relaxed) - baseline[counter];
+        portEXIT_CRITICAL(&mux);
+        return value;
+    }
+
+    void reset() {
+        portENTER_CRITICAL(&mux);
+        for (int i = 0; i < PIPELINE_COUNTER_COUNT; i++) {
+            baseline[i] = counters[i].load(std::memory_order_relaxed);
+        }
+        portEXIT_CRITICAL(&mux);
+    }
+};
+
+#endif /* F0C4A8E3_5B19_4D27_A6E2_91D3B7F5C048 */
@@ -0,0 +1,80 @@
+#ifndef D9931EC9_EEC4_4FAF_AF28_57CBA9790B5D
+#define D9931EC9_EEC4_4FAF_AF28_57CBA9790B5D
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+/**
+ * Minimal time between two samples of stacks and heap.
+ */
+#define RESOURCE_SAMPLE_PERIOD_MS 1000
+
+/**
+ * Free stack below this amount of bytes is reported to serial.
+ */
+#define STACK_LOW_WATER_BYTES 512
+
+/**
+ * Monitored tasks in order of iregStackFree* registers.
+ */
+enum MONITORED_TASK {
+    mtLoopTask = 0,
+    mtDisplayTask,
+    mtModbusTask,
+    mtModbusRtuTask,
+    mtScheduleTask,
+    MONITORED_TASK_COUNT
+};
+
+/**
+ * Samples stack high-water marks of tasks and heap state. Sampled by modbus task, results can be read from any task.
+ */
+class ResourceMonitor {
+    TaskHandle_t tasks[MONITORED_TASK_COUNT] = {};
+    bool lowStackReported[MONITORED_TASK_COUNT] = {};
+    uint32_t lastSampleMillis = 0;
+
+    // results of last sample, 0 for tasks which do not run
+    volatile uint32_t stackFree[MONITORED_TASK_COUNT] = {};
+    volatile uint32_t heapFree = 0;
+    volatile uint32_t heapLargestBlock = 0;
+    volatile uint32_t heapMinFree = 0;
+
+    void setStackFree(MONITORED_TASK task, uint32_t bytes);
+
+public:
+    /**
+     * Adds task to monitoring, called right after the task is created.
+     */
+    void setTask(MONITORED_TASK task, TaskHandle_t handle) {
+        tasks[task] = handle;
+    }
+
+    /**
+     * Samples calling task once, used for tasks which delete themselves.
+     */
+    void sampleCurrentTask(MONITORED_TASK task);
+
+    /**
+     * Samples all monitored tasks and heap, at most once per RESOURCE_SAMPLE_PERIOD_MS.
+     */
+    void sample();
+
+    uint32_t getStackFree(MONITORED_TASK task) {
+        return stackFree[task];
+    }
+    uint32_t getHeapFree() {
+        return heapFree;
+    }
+    uint32_t getHeapLargestBlock() {
+        return heapLargestBlock;
+    }
+    uint32_t getHeapMinFree() {
+        return heapMinFree;
+    }
+};
+
+extern ResourceMonitor resourceMonitor;
+
+#endif /* D9931EC9_EEC4_4FAF_AF28_57CBA9790B5D */
@@ -0,0 +1,87 @@
+#ifndef C86957E5_4547_47C0_941B_CA0267719204
+#define C86957E5_4547_47C0_941B_CA0267719204
+
+#include <atomic>
+#include <cstdint>
+#include <freertos/FreeRTOS.h>
+
+/**
+ * Number of weekly schedule entries of each unit.
+ */
+#define SCHEDULE_MAX_ENTRIES 16
+
+/**
+ * Number of holding registers of one entry, fields are in order of SCHEDULE_FIELD.
+ */
+#define SCHEDULE_ENTRY_REGISTERS 4
+
+// power field value which keeps power unchanged
+#define SCHEDULE_POWER_KEEP 2
+// target temperature field value which keeps target unchanged
+#define SCHEDULE_TEMP_KEEP 0
+
+#define MINUTES_PER_DAY (24 * 60)
+#define MINUTES_PER_WEEK (7 * MINUTES_PER_DAY)
+
+enum SCHEDULE_FIELD {
+    // bit mask of days, bit n is weekday n, 0 is Sunday. 0 disables the entry.
+    sfDays = 0,
+    // local time of the entry in minutes since midnight, 0 - 1439
+    sfMinute,
+    // 0 off, 1 on, SCHEDULE_POWER_KEEP unchanged
+    sfPower,
+    // target temperature in the format of hregTempTarget, SCHEDULE_TEMP_KEEP unchanged
+    sfTempTarget
+};
+
+struct ScheduleEntry {
+    uint16_t fields[SCHEDULE_ENTRY_REGISTERS];
+};
+
+/**
+ * The most recent entries which switch power and set target temperature.
+ */
+struct ScheduleAction {
+    // -1 if no entry is due
+    int8_t power;
+    // SCHEDULE_TEMP_KEEP if no entry is due
+    uint16_t tempTarget;
+};
+
+/**
+ * Weekly schedule of power and target temperature of one unit. Edited by modbus task, executed by schedule task.
+ */
+class Schedule {
+    ScheduleEntry entries[SCHEDULE_MAX_ENTRIES] = {};
+    portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+    std::atomic<bool> changed{ false };
+
+public:
+    uint16_t getField(uint8_t entry, SCHEDULE_FIELD field);
+    /**
+     * Sets field of entry if value is valid for the field.
+     * @return false if value is invalid
+     */
+    bool setField(uint8_t entry, SCHEDULE_FIELD field, uint16_t value);
+    void getEntries(ScheduleEntry* copy);
+    /**
+     * Sets entries restored from flash. Called before tasks start.
+     */
+    void setEntries(const ScheduleEntry* restored);
+    /**
+     * Returns true once after any entry has been changed, so entries can be saved.
+     */
+    bool takeChanged() {
+        return changed.exchange(false);
+    }
+
+    /**
+     * Finds the most recent entries which occurred within last windowMinutes, including the current minute.
+     * @param minuteOfWeek current local time in minutes since Sunday midnight
+     */
+    ScheduleAction findDue(uint16_t minuteOfWeek, uint16_t windowMinutes);
+};
+
+void scheduleTask(void* pvParameters);
+
+#endif /* C86957E5_4547_47C0_941B_CA0267719204 */
@@ -0,0 +1,55 @@
+#ifndef E7A2C95D_31B4_4F0E_8D6A_5B0C7E94A213
+#define E7A2C95D_31B4_4F0E_8D6A_5B0C7E94A213
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+/**
+ * Publishes a value of trivially copyable type T from one writer task to any number of reader tasks.
+ * Writer never blocks, readers retry until they get a copy which was not modified during the read.
+ */
+template <typename T>
+class SeqLock {
+    std::atomic<uint32_t> sequence{ 0 };
+    T data;
+
+public:
+    SeqLock(const T& initialValue) : data(initialValue) {
+    }
+
+    /**
+     * Must be called by a single writer task only.
+     */
+    void write(const T& value) {
+        uint32_t seq = sequence.load(std::memory_order_relaxed);
+        // odd sequence marks write in progress
+        sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy((void*)&data, &value, sizeof(T));
+        sequence.store(seq + 2, std::memory_order_release);
+    }
+
+    T read() const {
+        T value;
+        uint32_t seq1, seq2;
+        uint8_t attempts = 0;
+        while (true) {
+            seq1 = sequence.load(std::memory_order_acquire);
+            memcpy(&value, (const void*)&data, sizeof(T));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            seq2 = sequence.load(std::memory_order_relaxed);
+            if (!(seq1 & 1) && seq1 == seq2) {
+                return value;
+            }
+            if (++attempts > 10) {
+                // writer preempted on the same core, let it finish
+                vTaskDelay(1);
+            }
+        }
+    }
+};
+
+#endif /* E7A2C95D_31B4_4F0E_8D6A_5B0C7E94A213 */
@@ -0,0 +1,65 @@
+#ifndef A3E8D1F6_27C4_4B9A_95E0_C81B4D7F2A63
+#define A3E8D1F6_27C4_4B9A_95E0_C81B4D7F2A63
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Source of time for all timing dependent logic, replaceable by VirtualTimeSource in tests and host builds.
+ */
+class TimeSource {
+public:
+    virtual uint64_t micros() = 0;
+    virtual void delay(uint32_t ms) = 0;
+
+    /**
+     * Millis since start, wraps around at UINT32_MAX like Arduino millis().
+     */
+    uint32_t millis() {
+        return (uint32_t)(micros() / 1000ULL);
+    }
+};
+
+/**
+ * Real time of esp_timer, delay blocks calling task.
+ */
+class SystemTimeSource : public TimeSource {
+public:
+    uint64_t micros() override;
+    void delay(uint32_t ms) override;
+};
+
+/**
+ * Time which moves only when set or advanced. Delay fast-forwards time instead of blocking, so multi-second waits
+ * and timeouts take no real time.
+ */
+class VirtualTimeSource : public TimeSource {
+    std::atomic<uint64_t> nowUs;
+
+public:
+    VirtualTimeSource(uint64_t startUs = 0) : nowUs(startUs) {
+    }
+
+    uint64_t micros() override {
+        return nowUs.load();
+    }
+
+    void delay(uint32_t ms) override {
+        advanceMillis(ms);
+    }
+
+    void advanceMillis(uint32_t ms) {
+        nowUs.fetch_add(ms * 1000ULL);
+    }
+
+    void setMillis(uint64_t ms) {
+        nowUs.store(ms * 1000ULL);
+    }
+};
+
+/**
+ * Current time source, SystemTimeSource by default.
+ */
+extern TimeSource* timeSource;
+
+#endif /* A3E8D1F6_27C4_4B9A_95E0_C81B4D7F2A63 */
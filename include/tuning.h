@@ -0,0 +1,63 @@
+#ifndef FAC56B83_107C_46E9_AD83_4BDA35EC9D41
+#define FAC56B83_107C_46E9_AD83_4BDA35EC9D41
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Timing parameters adjustable at runtime, in order of hregTune* registers.
+ */
+enum TUNING_PARAM {
+    tpDisplayPeriodMs = 0,
+    tpSpiTimeoutMs,
+    tpModbusIdleMs,
+    tpSettleReads,
+    tpRefreshTimeoutMs,
+    tpPowerOnTimeoutMs,
+    tpSetTempTimeoutMs,
+    tpPressKeyMarginMs,
+    tpStaleReadS,
+    tpAutoTuneBus,
+    TUNING_PARAM_COUNT
+};
+
+struct TuningParam {
+    const char* name;
+    uint16_t defaultValue;
+    uint16_t minValue;
+    uint16_t maxValue;
+};
+
+extern const TuningParam tuningParams[TUNING_PARAM_COUNT];
+
+/**
+ * Current values of timing parameters. Set by modbus task, read by any task.
+ */
+class Tuning {
+    std::atomic<uint16_t> values[TUNING_PARAM_COUNT];
+    std::atomic<bool> changed{ false };
+
+public:
+    Tuning();
+
+    uint16_t get(TUNING_PARAM param) {
+        return values[param];
+    }
+
+    /**
+     * Sets value if it is within allowed range of the parameter.
+     * @return false if value is out of range
+     */
+    bool set(TUNING_PARAM param, uint16_t value);
+
+    /**
+     * Returns true once after any value has been set, so values can be saved.
+     */
+    bool takeChanged() {
+        return changed.exchange(false);
+    }
+};
+
+extern Tuning tuning;
+
+#endif /* FAC56B83_107C_46E9_AD83_4BDA35EC9D41 */
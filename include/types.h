@@ -1,11 +1,44 @@
 #ifndef D1041C14_9E57_40EF_85D0_1305BC6D1DDB
 #define D1041C14_9E57_40EF_85D0_1305BC6D1DDB
 
+#include <cstdint>
+
 /**
  * Represents invalid temperature.
  */
 #define INVALID_TEMP -128
 
+/**
+ * All registers of unit n (counted from 0) are at address + n * UNIT_REGISTER_OFFSET.
+ */
+#define UNIT_REGISTER_OFFSET 1000
+
+/**
+ * Returns index of unit which owns register at address.
+ */
+inline uint8_t unitIndexOfRegister(uint16_t address) {
+    return address / UNIT_REGISTER_OFFSET;
+}
+
+/**
+ * Returns MODBUS_REGISTERS value of register at address of any unit.
+ */
+inline uint16_t registerWithinUnit(uint16_t address) {
+    return address % UNIT_REGISTER_OFFSET;
+}
+
+/**
+ * Returns address of register 0 of unit.
+ */
+inline uint16_t unitRegisterBase(uint8_t unitIndex) {
+    return unitIndex * UNIT_REGISTER_OFFSET;
+}
+
+/**
+ * Registers of heating flag statistics of DUTY_FLAG n are at iregDutyHot* address + n * DUTY_REGISTER_STRIDE.
+ */
+#define DUTY_REGISTER_STRIDE 10
+
 enum MODBUS_REGISTERS {
     /**
      * @brief Current mode of display, updated immediately. Value is on of MODE enum values.
@@ -15,6 +48,7 @@ enum MODBUS_REGISTERS {
      * @brief Amount of seconds since last successful update of status. Status means all Input and Coil registers except iregDisplayMode.
      *
      * Value 65535 means unknow or older than 65535 seconds.
+     * After restart, status is restored from flash and flag sfRestored is set until next refresh.
      */
     iregStatusAge = 101,
     /**
@@ -52,6 +86,41 @@ enum MODBUS_REGISTERS {
      */
     iregTempTh = 108,
 
+    /**
+     * Value shown on info screen CE, captured whenever the screen is displayed. Value is two ASCII characters
+     * of the value digits, high byte first, '?' for unrecognized digit. 0 means the screen was not shown yet.
+     */
+    iregInfoCE = 110,
+    /**
+     * Value shown on info screen ER1, same format as iregInfoCE.
+     */
+    iregInfoER1 = 111,
+    /**
+     * Value shown on info screen ER2, same format as iregInfoCE.
+     */
+    iregInfoER2 = 112,
+    /**
+     * Value shown on info screen ER3, same format as iregInfoCE.
+     */
+    iregInfoER3 = 113,
+    /**
+     * Value shown on info screen D7F, same format as iregInfoCE.
+     */
+    iregInfoD7F = 114,
+
+    /**
+     * Duration of short key press used by key sequences, in ms. Calibrated by cregCalibrateKeyPresses, default 100.
+     */
+    iregPressTapMs = 120,
+    /**
+     * Duration of key press entering and leaving info screens, in ms. Default 1100.
+     */
+    iregPressInfoToggleMs = 121,
+    /**
+     * Duration of key press unlocking display, in ms. Default 3200.
+     */
+    iregPressUnlockMs = 122,
+
 
     /**
      * Any write to this register enforces status refresh of all other values to be get. Operation can take up to 9 seconds.
@@ -72,7 +141,268 @@ enum MODBUS_REGISTERS {
     /**
      * Writing value presses key for specified time. Value is: `(Key id from KEYS enum) << 8 + (press duration in ms) / 100`
      */
-    hregPressKey = 310
+    hregPressKey = 310,
+
+
+    /**
+     * Diagnostics: max deviation of display task period from hregTuneDisplayPeriodMs in last 10 s window, in microseconds.
+     * All diagnostic values in microseconds are limited to 65535.
+     */
+    iregDisplayTaskJitterMax = 400,
+    /**
+     * Diagnostics: average deviation of display task period in last 10 s window, in microseconds.
+     */
+    iregDisplayTaskJitterAvg = 401,
+    /**
+     * Diagnostics: max duration of one display task iteration in last 10 s window, in microseconds.
+     */
+    iregDisplayTaskBusyMax = 402,
+    /**
+     * Diagnostics: max deviation of display task period since start, in microseconds.
+     */
+    iregDisplayTaskJitterMaxEver = 403,
+
+    /**
+     * Diagnostics: number of frames received from display since reset by cregResetDiagnostics.
+     * All diagnostic counters are 32-bit values in two registers, high word first.
+     */
+    iregFramesReceived = 410,
+    /**
+     * Diagnostics: number of frames with unexpected length or header.
+     */
+    iregFramesBad = 412,
+    /**
+     * Diagnostics: number of display SPI transactions not completed within timeout.
+     */
+    iregSpiTimeouts = 414,
+    /**
+     * Diagnostics: number of failures to queue display SPI transaction.
+     */
+    iregSpiQueueFailures = 416,
+    /**
+     * Diagnostics: number of failures to get result of display SPI transaction.
+     */
+    iregSpiResultFailures = 418,
+    /**
+     * Diagnostics: number of digits which could not be decoded.
+     */
+    iregBcdErrors = 420,
+    /**
+     * Diagnostics: number of frames with unknown content of info label digits.
+     */
+    iregUnknownTdPatterns = 422,
+    /**
+     * Diagnostics: number of re-initialisations of display SPI slave by fault recovery.
+     */
+    iregSpiReinits = 424,
+    /**
+     * Diagnostics: number of keyboard column pins found driven as outputs while no key was pressed and reset to inputs.
+     */
+    iregKeyboardResets = 426,
+
+    /**
+     * Diagnostics: minimum free stack of loopTask in bytes. Task ends after setup, value is sampled at its end.
+     * Stack and heap registers are available only in registers of the first unit, 0 means task does not run.
+     */
+    iregStackFreeLoopTask = 430,
+    /**
+     * Diagnostics: minimum free stack of displayTask since start in bytes.
+     */
+    iregStackFreeDisplayTask = 431,
+    /**
+     * Diagnostics: minimum free stack of modbusTask since start in bytes.
+     */
+    iregStackFreeModbusTask = 432,
+    /**
+     * Diagnostics: minimum free stack of modbusRtuTask since start in bytes.
+     */
+    iregStackFreeModbusRtuTask = 433,
+    /**
+     * Diagnostics: minimum free stack of scheduleTask since start in bytes.
+     */
+    iregStackFreeScheduleTask = 434,
+    /**
+     * Diagnostics: free heap in bytes, 32-bit value in two registers, high word first.
+     */
+    iregHeapFree = 440,
+    /**
+     * Diagnostics: largest free block of heap in bytes, 32-bit value. Falling value with stable free heap means fragmentation.
+     */
+    iregHeapLargestBlock = 442,
+    /**
+     * Diagnostics: minimum free heap since start in bytes, 32-bit value.
+     */
+    iregHeapMinFree = 444,
+
+    /**
+     * Diagnostics: number of display bus faults since the last good frame. Faults are bad frames, failed SPI calls
+     * and timeouts while display sends frames. SPI slave is re-initialised after 5 faults.
+     */
+    iregRecoveryFaults = 450,
+    /**
+     * Diagnostics: number of restarts done because re-initialisations of SPI slave did not help, since flashing.
+     * Available only in registers of the first unit.
+     */
+    iregRecoveryRestarts = 451,
+
+    /**
+     * Statistics: total time Hot icon was shown since start in seconds, 32-bit value in two registers, high word first.
+     * Flags are visible in locked and unlocked mode only, last seen state is assumed meanwhile. Statistics of EHeat
+     * icon are at the same addresses + 10, statistics of Pump icon + 20.
+     */
+    iregDutyHotOnSeconds = 500,
+    /**
+     * Statistics: number of times Hot icon was switched on since start, 32-bit value.
+     */
+    iregDutyHotCycles = 502,
+    /**
+     * Statistics: seconds since Hot icon was switched on, 32-bit value, 0xFFFFFFFF means never since start.
+     */
+    iregDutyHotLastOnAge = 504,
+    /**
+     * Statistics: seconds since Hot icon was switched off, 32-bit value, 0xFFFFFFFF means never since start.
+     */
+    iregDutyHotLastOffAge = 506,
+    /**
+     * Statistics: duty cycle of Hot icon over last hour in 0.01 %, 0 - 10000.
+     */
+    iregDutyHotHour = 508,
+    /**
+     * Statistics: duty cycle of Hot icon over last 24 hours in 0.01 %, 0 - 10000.
+     */
+    iregDutyHotDay = 509,
+    iregDutyEHeatOnSeconds = 510,
+    iregDutyPumpOnSeconds = 520,
+
+    /**
+     * Diagnostics: number of key sequence steps 0 - 15 re-synchronised after failed display mode check, one register
+     * per step. Failures of steps above 15 are counted in the last register.
+     */
+    iregStepRetries = 800,
+    /**
+     * Diagnostics: number of key sequences cancelled in steps 0 - 15 after the retry budget was used or the step
+     * could not be resumed, one register per step.
+     */
+    iregStepAborts = 820,
+
+    /**
+     * Diagnostics: average period of display frames in microseconds, measured on CS edges over last 256 frames.
+     */
+    iregBusFramePeriodAvgUs = 460,
+    /**
+     * Diagnostics: shortest period of display frames in last 256 frames, in microseconds.
+     */
+    iregBusFramePeriodMinUs = 461,
+    /**
+     * Diagnostics: longest period of display frames in last 256 frames, in microseconds.
+     */
+    iregBusFramePeriodMaxUs = 462,
+    /**
+     * Diagnostics: max deviation of frame period from average of previous window, in microseconds.
+     */
+    iregBusFrameJitterMaxUs = 463,
+    /**
+     * Diagnostics: average time CS is low during one frame, in microseconds.
+     */
+    iregBusCsLowUs = 464,
+    /**
+     * Diagnostics: average display bus clock rate while CS is low, in kHz.
+     */
+    iregBusClockKHz = 465,
+    /**
+     * Diagnostics: average time from end of frame (CS high) to completion of SPI transaction, in microseconds.
+     */
+    iregBusCompletionLatencyUs = 466,
+
+    /**
+     * Any write to this register resets all diagnostic counters.
+     */
+    cregResetDiagnostics = 220,
+
+    /**
+     * Writing 1 starts calibration of key press durations iregPress*Ms, reads 1 until calibration is finished.
+     * Calibration presses keys for several minutes, commands requested meanwhile fail. Unlock duration is calibrated
+     * only if display locks itself within 5 minutes.
+     */
+    cregCalibrateKeyPresses = 230,
+
+    /**
+     * Tuning: period of display task in ms, 10 - 100, default 30.
+     * All tuning registers are validated, out of range value is rejected and the register keeps the current value.
+     * Values are saved to flash and applied immediately. Registers 600 - 607 are common for all units and they are
+     * available at addresses of the first unit only.
+     */
+    hregTuneDisplayPeriodMs = 600,
+    /**
+     * Tuning: timeout of display SPI transaction in ms, 500 - 60000, default 5000.
+     */
+    hregTuneSpiTimeoutMs = 601,
+    /**
+     * Tuning: max time modbus task waits for request before serving other work in ms, 1 - 1000, default 20.
+     */
+    hregTuneModbusIdleMs = 602,
+    /**
+     * Tuning: number of display frames read after key up before key sequence continues, 1 - 20, default 3.
+     */
+    hregTuneSettleReads = 603,
+    /**
+     * Tuning: timeout of cregRefreshStatus write in ms, 1000 - 60000, default 10000.
+     */
+    hregTuneRefreshTimeoutMs = 604,
+    /**
+     * Tuning: timeout of cregPowerOn write in ms, 1000 - 60000, default 7000.
+     */
+    hregTunePowerOnTimeoutMs = 605,
+    /**
+     * Tuning: timeout of hregTempTarget write in ms, 1000 - 60000, default 13000.
+     */
+    hregTuneSetTempTimeoutMs = 606,
+    /**
+     * Tuning: time added to key press duration as timeout of hregPressKey write in ms, 0 - 10000, default 1000.
+     */
+    hregTunePressKeyMarginMs = 607,
+    /**
+     * Tuning: age in seconds after which read of iregTemp* or hregTempTarget starts background refresh of the value,
+     * cached value is returned immediately. 0 - 3600, default 0 disables background refresh.
+     */
+    hregTuneStaleReadS = 608,
+    /**
+     * Tuning: 1 derives hregTuneDisplayPeriodMs, hregTuneSpiTimeoutMs and hregTuneSettleReads from measured display bus
+     * cadence (iregBusFrame*), 0 keeps them as set. Default 0.
+     */
+    hregTuneAutoBus = 609,
+    /**
+     * Tuning: duration of short key press in ms, 20 - 1000. Same value as iregPressTapMs, it is also set by calibration.
+     */
+    hregTunePressTapMs = 610,
+    /**
+     * Tuning: duration of key press entering and leaving info screens in ms, 200 - 5000.
+     */
+    hregTunePressInfoToggleMs = 611,
+    /**
+     * Tuning: duration of key press unlocking display in ms, 500 - 10000.
+     */
+    hregTunePressUnlockMs = 612,
+
+    /**
+     * Schedule: days of entry 0 as bit mask, bit n is weekday n, 0 is Sunday. 0 disables the entry.
+     * Schedule has 16 entries of 4 registers, entry n is at address + 4 * n. Entries are run in local time of
+     * SCHEDULE_TZ synchronised by NTP, entries missed while device was off are applied after start: the most recent
+     * power and target temperature of the last week are set.
+     */
+    hregScheduleDays = 700,
+    /**
+     * Schedule: time of entry 0 in minutes since midnight, 0 - 1439.
+     */
+    hregScheduleMinute = 701,
+    /**
+     * Schedule: power set by entry 0, 0 off, 1 on, 2 unchanged.
+     */
+    hregSchedulePower = 702,
+    /**
+     * Schedule: target temperature set by entry 0 in the same format as hregTempTarget, 0 unchanged.
+     */
+    hregScheduleTempTarget = 703,
 };
 
 enum MODE {
@@ -114,12 +444,30 @@ enum KEYS {
 
 const char* enumToString(KEYS value);
 
+/**
+ * Index of temperature sensor in order of the info screens and iregTemp* registers.
+ */
+enum TEMP_SENSOR {
+    tsT5U = 0,
+    tsT5L,
+    tsT3,
+    tsT4,
+    tsTP,
+    tsTh,
+    TEMP_SENSOR_COUNT
+};
+
 enum STATUS_FLAGS {
     sfPowerOn = 1 << 0,
     sfHot = 1 << 1,
     sfEHeat = 1 << 2,
     sfPump = 1 << 3,
-    sfVacation = 1 << 4
+    sfVacation = 1 << 4,
+    /**
+     * Values were restored from flash after restart and not refreshed since. Their ages don't include time when
+     * device was switched off.
+     */
+    sfRestored = 1 << 5
 };
 
 #endif /* D1041C14_9E57_40EF_85D0_1305BC6D1DDB */
@@ -0,0 +1,139 @@
+#include <Arduino.h>
+#include <esp_timer.h>
+#include "busProfiler.h"
+#include "heatPumpUnit.h"
+
+// time display needs to show result of key press, 3 frames of default 30 ms display task period
+#define BUS_SETTLE_US 90000
+// SPI transaction times out after this number of frame periods
+#define BUS_TIMEOUT_PERIODS 10
+// display task period is this percentage of the shortest frame period, so no frame is missed
+#define BUS_WAKE_PERCENT 90
+// tuned value is changed only if it differs more, so flash is not written on every window
+#define BUS_AUTO_TUNE_HYSTERESIS_PERCENT 10
+
+void IRAM_ATTR BusProfiler::onCsEdge(bool high) {
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL_ISR(&mux);
+    if (high) {
+        if (csFallUs) {
+            windowCsLowSumUs += now - csFallUs;
+            windowCsLowCount++;
+        }
+        csRiseUs = now;
+    } else {
+        if (csFallUs) {
+            uint32_t period = now - csFallUs;
+            periodHistogram[min(period / BUS_PERIOD_BIN_US, (uint32_t)BUS_HISTOGRAM_BINS - 1)]++;
+            if (published.frames) {
+                uint32_t jitter = (period > published.periodAvgUs) ? period - published.periodAvgUs : published.periodAvgUs - period;
+                jitterHistogram[min(jitter / BUS_JITTER_BIN_US, (uint32_t)BUS_HISTOGRAM_BINS - 1)]++;
+                windowJitterMaxUs = max(windowJitterMaxUs, jitter);
+            }
+            windowPeriodSumUs += period;
+            windowPeriodMinUs = min(windowPeriodMinUs, period);
+            windowPeriodMaxUs = max(windowPeriodMaxUs, period);
+            if (++windowFrames >= BUS_PROFILE_WINDOW_FRAMES) {
+                publishWindow();
+            }
+        }
+        csFallUs = now;
+        frameCount++;
+    }
+    portEXIT_CRITICAL_ISR(&mux);
+}
+
+void IRAM_ATTR BusProfiler::onTransactionDone() {
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL_ISR(&mux);
+    if (csRiseUs) {
+        windowLatencySumUs += now - csRiseUs;
+        windowLatencyCount++;
+    }
+    portEXIT_CRITICAL_ISR(&mux);
+}
+
+void IRAM_ATTR BusProfiler::publishWindow() {
+    published.frames = windowFrames;
+    published.periodAvgUs = windowPeriodSumUs / windowFrames;
+    published.periodMinUs = windowPeriodMinUs;
+    published.periodMaxUs = windowPeriodMaxUs;
+    published.jitterMaxUs = windowJitterMaxUs;
+    published.csLowAvgUs = windowCsLowCount ? windowCsLowSumUs / windowCsLowCount : 0;
+    published.clockKHz = published.csLowAvgUs ? DISPLAY_FRAME_BITS * 1000 / published.csLowAvgUs : 0;
+    published.completionLatencyAvgUs = windowLatencyCount ? windowLatencySumUs / windowLatencyCount : 0;
+    publishCount++;
+
+    windowFrames = windowCsLowCount = windowLatencyCount = 0;
+    windowPeriodSumUs = windowCsLowSumUs = windowLatencySumUs = 0;
+    windowPeriodMinUs = UINT32_MAX;
+    windowPeriodMaxUs = windowJitterMaxUs = 0;
+}
+
+BusProfile BusProfiler::getProfile() {
+    portENTER_CRITICAL(&mux);
+    BusProfile profile = published;
+    portEXIT_CRITICAL(&mux);
+    return profile;
+}
+
+void BusProfiler::getHistograms(uint32_t* period, uint32_t* jitter) {
+    portENTER_CRITICAL(&mux);
+    memcpy(period, periodHistogram, sizeof(periodHistogram));
+    memcpy(jitter, jitterHistogram, sizeof(jitterHistogram));
+    portEXIT_CRITICAL(&mux);
+}
+
+void BusProfiler::reset() {
+    portENTER_CRITICAL(&mux);
+    memset(periodHistogram, 0, sizeof(periodHistogram));
+    memset(jitterHistogram, 0, sizeof(jitterHistogram));
+    portEXIT_CRITICAL(&mux);
+}
+
+/**
+ * Sets tuning parameter if value differs from the current one by more than hysteresis.
+ */
+void autoTune(TUNING_PARAM param, uint32_t value) {
+    const TuningParam& def = tuningParams[param];
+    value = constrain(value, (uint32_t)def.minValue, (uint32_t)def.maxValue);
+    uint32_t current = tuning.get(param);
+    uint32_t diff = (value > current) ? value - current : current - value;
+    if (diff && diff * 100 >= current * BUS_AUTO_TUNE_HYSTERESIS_PERCENT) {
+        Serial.printf("INFO: %s auto tuned %d -> %d\n", def.name, (int)current, (int)value);
+        tuning.set(param, value);
+    }
+}
+
+void autoTuneBusTiming() {
+    static uint32_t lastPublishCount[UNIT_COUNT] = {};
+    if (!tuning.get(TUNING_PARAM::tpAutoTuneBus)) {
+        return;
+    }
+    // the fastest unit determines display task period, the slowest one SPI timeout
+    bool updated = false;
+    uint32_t periodMinUs = UINT32_MAX;
+    uint32_t periodMaxUs = 0;
+    uint32_t periodAvgUs = 0;
+    for (auto& unit : units) {
+        uint32_t publishCount = unit.busProfiler.getPublishCount();
+        updated |= publishCount != lastPublishCount[unit.getIndex()];
+        lastPublishCount[unit.getIndex()] = publishCount;
+        BusProfile profile = unit.busProfiler.getProfile();
+        if (!profile.frames) {
+            // unit without measured cadence yet
+            return;
+        }
+        periodMinUs = min(periodMinUs, profile.periodMinUs);
+        periodMaxUs = max(periodMaxUs, profile.periodMaxUs);
+        periodAvgUs = max(periodAvgUs, profile.periodAvgUs);
+    }
+    if (!updated) {
+        return;
+    }
+
+    autoTune(TUNING_PARAM::tpDisplayPeriodMs, periodMinUs * BUS_WAKE_PERCENT / 100 / 1000);
+    autoTune(TUNING_PARAM::tpSpiTimeoutMs, periodMaxUs * BUS_TIMEOUT_PERIODS / 1000);
+    // reads are counted per frame, display needs the same time whatever the frame rate is
+    autoTune(TUNING_PARAM::tpSettleReads, (BUS_SETTLE_US + periodAvgUs - 1) / periodAvgUs);
+}
@@ -0,0 +1,35 @@
+#include <Arduino.h>
+#include "commandTrace.h"
+#include "timeSource.h"
+
+void CommandTrace::record(TRACE_EVENT type, uint8_t unit, uint8_t arg, uint16_t value, uint8_t step) {
+    TraceEvent event = { timeSource->micros(), value, type, unit, step, arg };
+    portENTER_CRITICAL(&mux);
+    events[nextIndex % TRACE_BUFFER_SIZE] = event;
+    nextIndex++;
+    portEXIT_CRITICAL(&mux);
+}
+
+uint32_t CommandTrace::getFirstIndex() {
+    portENTER_CRITICAL(&mux);
+    uint32_t first = (nextIndex > TRACE_BUFFER_SIZE) ? nextIndex - TRACE_BUFFER_SIZE : 0;
+    portEXIT_CRITICAL(&mux);
+    return first;
+}
+
+uint32_t CommandTrace::getEndIndex() {
+    portENTER_CRITICAL(&mux);
+    uint32_t end = nextIndex;
+    portEXIT_CRITICAL(&mux);
+    return end;
+}
+
+bool CommandTrace::get(uint32_t index, TraceEvent& event) {
+    portENTER_CRITICAL(&mux);
+    bool valid = index < nextIndex && nextIndex - index <= TRACE_BUFFER_SIZE;
+    if (valid) {
+        event = events[index % TRACE_BUFFER_SIZE];
+    }
+    portEXIT_CRITICAL(&mux);
+    return valid;
+}
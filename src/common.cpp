@@ -1,5 +1,50 @@
 #include <Arduino.h>
 #include "common.h"
+#include "keySequences.h"
+
+void StateData::applyFrame(const DisplayFrame& frame) {
+    setDisplayMode(frame.mode);
+
+    switch (frame.mode) {
+    case MODE::displayOff:
+        break;
+    case MODE::unlocked:
+    case MODE::locked:
+        setHot(frame.icons & DISPLAY_ICON::diHot);
+        setEHeat(frame.icons & DISPLAY_ICON::diEHeat);
+        setPump(frame.icons & DISPLAY_ICON::diPump);
+        setVacation(frame.icons & DISPLAY_ICON::diVacation);
+        break;
+    case MODE::setTemp:
+        setCurrentSetTempValue(frame.value);
+        break;
+    case MODE::infoT5U:
+        setTempT5U(frame.value);
+        break;
+    case MODE::infoT5L:
+        setTempT5L(frame.value);
+        break;
+    case MODE::infoT3:
+        setTempT3(frame.value);
+        break;
+    case MODE::infoT4:
+        setTempT4(frame.value);
+        break;
+    case MODE::infoTP:
+        setTempTP(frame.value);
+        break;
+    case MODE::infoTh:
+        setTempTh(frame.value);
+        break;
+    case MODE::infoCE:
+    case MODE::infoER1:
+    case MODE::infoER2:
+    case MODE::infoER3:
+    case MODE::infoD7F:
+        setInfoValue(frame.mode - MODE::infoCE, valueDigitsAsRegister(frame));
+        break;
+    }
+}
 
 #define CASE_ENTRY(e) case e: return #e
 
@@ -46,3 +91,17 @@ const char* enumToString(KEYS value) {
         return "???";
     }
 }
+
+const char* enumToString(KEY_SEQUENCE value) {
+    switch (value) {
+        CASE_ENTRY(KEY_SEQUENCE::ksNone);
+        CASE_ENTRY(KEY_SEQUENCE::ksRefreshStatus);
+        CASE_ENTRY(KEY_SEQUENCE::ksPowerOn);
+        CASE_ENTRY(KEY_SEQUENCE::ksSetTargetTemp);
+        CASE_ENTRY(KEY_SEQUENCE::ksPressKey);
+        CASE_ENTRY(KEY_SEQUENCE::ksCalibrate);
+        CASE_ENTRY(KEY_SEQUENCE::ksRefreshValue);
+    default:
+        return "???";
+    }
+}
@@ -0,0 +1,181 @@
+#include <cctype>
+#include <cstring>
+#include "displayFrame.h"
+
+/**
+ * Returns character shown by 7-segment digit, 0 for unknown segment combination. Bit 0 is not part of digit.
+ */
+char segmentsToChar(uint8_t c) {
+    switch (c & 0b11111110) {
+    case 0:
+        return ' ';
+    case 0b00000100:
+        return '-';
+    case 0b11111010:
+        return '0';
+    case 0b01100000:
+        return '1';
+    case 0b10111100:
+        return '2';
+    case 0b11110100:
+        return '3';
+    case 0b01100110:
+        return '4';
+    case 0b11010110:
+        return '5';
+    case 0b11011110:
+        return '6';
+    case 0b01110000:
+        return '7';
+    case 0b11111110:
+        return '8';
+    case 0b11110110:
+        return '9';
+    default:
+        return 0;
+    }
+}
+
+struct IconBit {
+    uint8_t byte;
+    uint8_t mask;
+    DISPLAY_ICON icon;
+};
+
+const IconBit iconBits[] = {
+    { 15, 1 << 0, DISPLAY_ICON::diLocked },
+    { 13, 1 << 7, DISPLAY_ICON::diSetClock },
+    { 6, 1 << 4, DISPLAY_ICON::diSetTemp },
+    { 7, 1 << 4, DISPLAY_ICON::diSetVacation },
+    { 15, 1 << 4, DISPLAY_ICON::diHot },
+    { 14, 1 << 3, DISPLAY_ICON::diEHeat },
+    { 14, 1 << 6, DISPLAY_ICON::diPump },
+    { 14, 1 << 4, DISPLAY_ICON::diVacation },
+};
+
+/**
+ * Icons deciding display mode in order of priority.
+ */
+const struct {
+    uint16_t icon;
+    MODE mode;
+} modeIcons[] = {
+    { DISPLAY_ICON::diSetClock, MODE::setClock },
+    { DISPLAY_ICON::diLocked, MODE::locked },
+    { DISPLAY_ICON::diSetTemp, MODE::setTemp },
+    { DISPLAY_ICON::diSetVacation, MODE::setVacation },
+};
+
+// label digits of info screens, bytes 10 - 13 as little endian
+#define TD_MASK 0b01110000111111101111111011111110
+
+const struct {
+    uint32_t td;
+    MODE mode;
+} infoLabels[] = {
+    { 0b00000000100011101101011011101010, MODE::infoT5U },
+    { 0b00000000100011101101011010001010, MODE::infoT5L },
+    { 0b00000000000000001000111011110100, MODE::infoT3 },
+    { 0b00000000000000001000111001100110, MODE::infoT4 },
+    { 0b00000000000000001000111000111110, MODE::infoTP },
+    { 0b00000000000000001000111001001110, MODE::infoTh },
+    { 0b00000000000000001001101010011110, MODE::infoCE },
+    { 0b00000000011000000000000000000000, MODE::infoER1 },
+    { 0b00000000101111000000000000000000, MODE::infoER2 },
+    { 0b00000000111101000000000000000000, MODE::infoER3 },
+    { 0b00000000111011000111000000011110, MODE::infoD7F },
+};
+
+int8_t digitsToNumber(const char* digits) {
+    // digits[0] is tens, digits[1] ones
+    if (!isdigit(digits[1])) {
+        return INVALID_TEMP;
+    }
+    int8_t res = digits[1] - '0';
+    if (isdigit(digits[0])) {
+        return res + (digits[0] - '0') * 10;
+    } else if (digits[0] == ' ') {
+        return res;
+    } else if (digits[0] == '-') {
+        return -res;
+    }
+    return INVALID_TEMP;
+}
+
+/**
+ * Returns two characters of value digits for modbus register, '?' for unknown digit.
+ */
+uint16_t valueDigitsAsRegister(const DisplayFrame& frame) {
+    char high = frame.valueDigits[0] ? frame.valueDigits[0] : '?';
+    char low = frame.valueDigits[1] ? frame.valueDigits[1] : '?';
+    return ((uint16_t)high << 8) | low;
+}
+
+/**
+ * Returns true for screens showing a temperature. Info screens CE - D7F can show letters which are not decoded.
+ */
+bool hasNumericValue(MODE mode) {
+    return mode == MODE::setTemp || (mode >= MODE::infoT5U && mode <= MODE::infoTh);
+}
+
+MODE decodeDisplayMode(const uint8_t* data, uint16_t icons) {
+    uint64_t firstHalf;
+    memcpy(&firstHalf, data, sizeof(firstHalf));
+    if (firstHalf == 0) return MODE::displayOff;
+
+    for (const auto& modeIcon : modeIcons) {
+        if (icons & modeIcon.icon) return modeIcon.mode;
+    }
+
+    uint32_t td;
+    memcpy(&td, data + 10, sizeof(td));
+    td &= TD_MASK;
+    for (const auto& infoLabel : infoLabels) {
+        if (td == infoLabel.td) return infoLabel.mode;
+    }
+    return MODE::unlocked;
+}
+
+/**
+ * Moves frame received 1 bit after the header byte to the beginning of buffer. Buffer holds 18 received bytes.
+ */
+void realignFrame(uint8_t* data) {
+    for (int i = 0; i < DISPLAY_FRAME_SIZE; i++) {
+        data[i] = (data[i + 1] << 1);
+        if (data[i + 2] & 0x80) {
+            data[i] += 1;
+        }
+    }
+}
+
+/**
+ * Decodes icons, mode and all digit groups of 16 byte frame.
+ */
+void decodeFrame(const uint8_t* data, DisplayFrame& frame) {
+    memcpy(frame.raw, data, DISPLAY_FRAME_SIZE);
+
+    frame.icons = 0;
+    for (const auto& iconBit : iconBits) {
+        if (data[iconBit.byte] & iconBit.mask) {
+            frame.icons |= iconBit.icon;
+        }
+    }
+    frame.mode = decodeDisplayMode(data, frame.icons);
+
+    // digit 12.3
+    frame.valueDigits[1] = segmentsToChar((data[3] << 4) + ((data[4] & 0b11100000) >> 4));
+    frame.valueDigits[0] = segmentsToChar((data[4] << 4) + ((data[5] & 0b11100000) >> 4));
+    frame.labelDigits[0] = segmentsToChar(data[12]);
+    frame.labelDigits[1] = segmentsToChar(data[11]);
+    frame.labelDigits[2] = segmentsToChar(data[10]);
+
+    frame.bcdErrors = 0;
+    if (hasNumericValue(frame.mode)) {
+        frame.bcdErrors = (frame.valueDigits[0] ? 0 : 1) + (frame.valueDigits[1] ? 0 : 1);
+    }
+    frame.value = digitsToNumber(frame.valueDigits);
+
+    // outside of info screens td digit positions show digits or blanks only
+    frame.unknownLabel = frame.mode == MODE::unlocked
+        && (!frame.labelDigits[0] || !frame.labelDigits[1] || !frame.labelDigits[2]);
+}
@@ -0,0 +1,74 @@
+#include <Arduino.h>
+#include "displayFrame.h"
+#include "dutyStats.h"
+
+const uint16_t dutyFlagIcons[DUTY_FLAG_COUNT] = { DISPLAY_ICON::diHot, DISPLAY_ICON::diEHeat, DISPLAY_ICON::diPump };
+
+void DutyStats::update(uint32_t nowMillis) {
+    if (!started) {
+        return;
+    }
+    uint32_t deltaMs = nowMillis - lastUpdateMillis;
+    lastUpdateMillis = nowMillis;
+    for (int i = 0; i < DUTY_FLAG_COUNT; i++) {
+        FlagStats& flag = flags[i];
+        shortWindows[i].add(elapsedMs, deltaMs, flag.on);
+        longWindows[i].add(elapsedMs, deltaMs, flag.on);
+        if (flag.on) {
+            onMsRemainder[i] += deltaMs;
+            flag.onSeconds += onMsRemainder[i] / 1000;
+            onMsRemainder[i] %= 1000;
+        }
+    }
+    elapsedMs += deltaMs;
+
+    if (nowMillis - lastPublishMillis >= DUTY_PUBLISH_PERIOD_MS) {
+        publish(nowMillis);
+    }
+}
+
+void DutyStats::observe(uint16_t icons, uint32_t nowMillis) {
+    // 0 is reserved for never
+    uint32_t timestamp = nowMillis ? nowMillis : 1;
+    if (!started) {
+        started = true;
+        lastUpdateMillis = nowMillis;
+        for (int i = 0; i < DUTY_FLAG_COUNT; i++) {
+            flags[i].on = icons & dutyFlagIcons[i];
+        }
+        publish(nowMillis);
+        return;
+    }
+
+    update(nowMillis);
+    bool changed = false;
+    for (int i = 0; i < DUTY_FLAG_COUNT; i++) {
+        FlagStats& flag = flags[i];
+        bool on = icons & dutyFlagIcons[i];
+        if (on == flag.on) {
+            continue;
+        }
+        flag.on = on;
+        changed = true;
+        if (on) {
+            flag.lastOnMillis = timestamp;
+            flag.cycles++;
+        } else {
+            flag.lastOffMillis = timestamp;
+        }
+    }
+    if (changed) {
+        publish(nowMillis);
+    }
+}
+
+void DutyStats::publish(uint32_t nowMillis) {
+    DutySnapshot published;
+    for (int i = 0; i < DUTY_FLAG_COUNT; i++) {
+        published.flags[i] = flags[i];
+        published.flags[i].dutyShort = shortWindows[i].getDuty(elapsedMs);
+        published.flags[i].dutyLong = longWindows[i].getDuty(elapsedMs);
+    }
+    snapshot.write(published);
+    lastPublishMillis = nowMillis;
+}
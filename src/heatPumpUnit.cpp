@@ -0,0 +1,190 @@
+#include <Arduino.h>
+#include <driver/spi_slave.h>
+#include <driver/gpio.h>
+
+#include "heatPumpUnit.h"
+
+HeatPumpUnit::HeatPumpUnit(uint8_t index, const UnitPins& pins)
+    : index(index), pins(pins), keyboard(index, stateData, pins.keyboard),
+      keyboardSequence(index, keyboard, stateData) {
+    spiReadTransaction = {};
+    spiReadTransaction.length = DISPLAY_FRAME_BITS;
+    spiReadTransaction.rx_buffer = displayBuff;
+    spiReadTransaction.user = this;
+}
+
+void IRAM_ATTR HeatPumpUnit::keyboardPulseInt(void* arg) {
+    ((HeatPumpUnit*)arg)->keyboard.onKeyboardInputRow1Low();
+}
+
+void IRAM_ATTR HeatPumpUnit::displayCsInt(void* arg) {
+    HeatPumpUnit* unit = (HeatPumpUnit*)arg;
+    unit->busProfiler.onCsEdge(GPIO_FAST_GET_LEVEL(unit->pins.displayCs));
+}
+
+void IRAM_ATTR HeatPumpUnit::displayDataReceived(spi_slave_transaction_t* t) {
+    HeatPumpUnit* unit = (HeatPumpUnit*)t->user;
+    unit->busProfiler.onTransactionDone();
+    unit->spiTransactionStared = false;
+    unit->displayDataReady = true;
+}
+
+void HeatPumpUnit::initializePins() {
+    keyboard.initializePins();
+}
+
+void HeatPumpUnit::initializeDisplay() {
+    // keyboard interrupts of all units are served by the same core, pulse of one unit can be delayed by another one
+    // busy waiting for its row. Such pulse is ignored and key is pressed at the next keyboard scan.
+    attachInterruptArg(pins.keyboard.inRows[0], keyboardPulseInt, this, FALLING);
+
+    pinMode(pins.displayCs, INPUT_PULLDOWN);
+    pinMode(pins.displayClk, INPUT_PULLDOWN);
+    pinMode(pins.displayData, INPUT_PULLDOWN);
+    startDisplayBus();
+}
+
+void HeatPumpUnit::startDisplayBus() {
+    spi_bus_config_t bcfg = {
+        .mosi_io_num = pins.displayData,
+        .miso_io_num = -1,
+        .sclk_io_num = pins.displayClk,
+    };
+    spi_slave_interface_config_t scfg = {
+        .spics_io_num = pins.displayCs,
+        .flags = 0,
+        .queue_size = 1,
+        .mode = 2,
+        .post_trans_cb = displayDataReceived,
+    };
+
+    esp_err_t spi_state = spi_slave_initialize(pins.spiHost, &bcfg, &scfg, SPI_DMA_DISABLED);
+    if (spi_state != ESP_OK) {
+        Serial.printf("SPI initialsation of unit %d failed!\n", (int)index);
+    }
+    // CS stays routed to SPI slave, interrupt only timestamps its edges
+    attachInterruptArg(pins.displayCs, displayCsInt, this, CHANGE);
+}
+
+/**
+ * Escalates recovery after a display bus fault: SPI slave and keyboard pins are re-initialised after
+ * RECOVERY_FAULTS_BEFORE_REINIT faults in a row, device is restarted when re-initialisations do not help.
+ * Restarts need RECOVERY_MIN_UPTIME_MS of uptime and stop after RECOVERY_MAX_RESTARTS_WITHOUT_FRAME restarts
+ * without a good frame, so a panel sending bad frames doesn't keep the device in a boot loop.
+ */
+void HeatPumpUnit::onBusFault() {
+    if (++faultsInRow < RECOVERY_FAULTS_BEFORE_REINIT) {
+        return;
+    }
+    if (reinitsWithoutFrame >= RECOVERY_REINITS_BEFORE_RESTART && stateData.getNow() >= RECOVERY_MIN_UPTIME_MS
+        && restartsWithoutFrame < RECOVERY_MAX_RESTARTS_WITHOUT_FRAME)
+    {
+        Serial.printf("ERR: display bus of unit %d not recovered, restarting\n", (int)index);
+        recoveryRestarts++;
+        restartsWithoutFrame++;
+        persistRecoveryRestarts();
+        ESP.restart();
+        return;
+    }
+
+    Serial.printf("ERR: %d display bus faults of unit %d, re-initialising\n", (int)faultsInRow, (int)index);
+    faultsInRow = 0;
+    reinitsWithoutFrame++;
+    pipelineCounters.increment(PIPELINE_COUNTER::pcSpiReinits);
+    spi_slave_free(pins.spiHost);
+    spiTransactionStared = false;
+    displayDataReady = false;
+    startDisplayBus();
+    if (!keyboard.isKeyDown()) {
+        keyboard.setKeyboardOutPinsAsInputs();
+    }
+}
+
+void HeatPumpUnit::displayLoop() {
+    stateData.onLoopStart();
+    stateData.publish();
+    dutyStats.update(stateData.getNow());
+
+    keyboard.onLoop();
+    if (keyboard.resetStuckOutPins()) {
+        pipelineCounters.increment(PIPELINE_COUNTER::pcKeyboardResets);
+    }
+    if (keyboardSequence.onLoop()) {
+        // key is down, no more actions
+        return;
+    }
+
+    if (bootRefreshPending && stateData.getDisplayMode() != MODE::unknown
+        && keyboardSequence.getCurrentSequence() == KEY_SEQUENCE::ksNone)
+    {
+        bootRefreshPending = false;
+        Serial.printf("No valid status of unit %d after start, refreshing\n", (int)index);
+        keyboardSequence.startKeySequence(KEY_SEQUENCE::ksRefreshStatus, 0);
+    }
+    keyboardSequence.startRequestedCalibration();
+    keyboardSequence.startRequestedRefresh();
+
+    // process data from display
+    if (displayDataReady) {
+        displayDataReady = false;
+        if (!handleDisplayDataReady()) {
+            return;
+        }
+        stateData.publish();
+        keyboardSequence.afterDisplayDataRead();
+    }
+
+    if (stateData.millisSince(lastTransactionStartedMillis) > tuning.get(TUNING_PARAM::tpSpiTimeoutMs) && spiTransactionStared) {
+        spiTransactionStared = false;
+        pipelineCounters.increment(PIPELINE_COUNTER::pcSpiTimeouts);
+        Serial.printf("Read display SPI transaction of unit %d time out!\n", (int)index);
+        if (busProfiler.getFrameCount() != frameCountAtTransactionStart) {
+            // display sends frames, but they are not received
+            onBusFault();
+        }
+    }
+
+    // start new read display transaction
+    if (!spiTransactionStared && GPIO_FAST_GET_LEVEL(pins.displayCs)) {
+        esp_err_t spi_state = spi_slave_queue_trans(pins.spiHost, &spiReadTransaction, portMAX_DELAY);
+        if (spi_state == ESP_OK) {
+            spiTransactionStared = true;
+            lastTransactionStartedMillis = stateData.getNow();
+            frameCountAtTransactionStart = busProfiler.getFrameCount();
+        } else {
+            pipelineCounters.increment(PIPELINE_COUNTER::pcQueueFailures);
+            Serial.printf("SPI trans of unit %d failed!\n", (int)index);
+            onBusFault();
+        }
+    }
+}
+
+bool HeatPumpUnit::handleDisplayDataReady() {
+    spi_slave_transaction_t* trans;
+    if (spi_slave_get_trans_result(pins.spiHost, &trans, portMAX_DELAY) != ESP_OK) {
+        pipelineCounters.increment(PIPELINE_COUNTER::pcResultFailures);
+        Serial.printf("ERR: Failed to get transaction result\n");
+        onBusFault();
+        return false;
+    }
+    pipelineCounters.increment(PIPELINE_COUNTER::pcFramesReceived);
+    uint8_t* data = (uint8_t*)spiReadTransaction.rx_buffer;
+    if (spiReadTransaction.trans_len == DISPLAY_FRAME_BITS && data[0] == 0b10100000) {
+        // printData(data, 18 * 8);
+        faultsInRow = 0;
+        reinitsWithoutFrame = 0;
+        if (restartsWithoutFrame) {
+            restartsWithoutFrame = 0;
+            persistRecoveryRestarts();
+        }
+        realignFrame(data);
+        decodeDisplayData();
+    } else {
+        pipelineCounters.increment(PIPELINE_COUNTER::pcFramesBad);
+        Serial.printf("SPI receive failed. Len=%d; header=%d\n", spiReadTransaction.trans_len, (int)data[0]);
+        printData(data, 18 * 8);
+        onBusFault();
+        return false;
+    }
+    return true;
+}
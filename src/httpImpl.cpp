@@ -0,0 +1,445 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include "common.h"
+#include "commandTrace.h"
+#include "fixedWriter.h"
+#include "heatPumpUnit.h"
+
+#define HTTP_PORT 80
+// max time to receive request line from connected client, it is received over several calls of handleHttp
+#define HTTP_REQUEST_TIMEOUT_MS 1000
+
+WiFiServer httpServer(HTTP_PORT);
+
+// body is sent in chunks when less than this is left in buffer
+#define HTTP_CHUNK_RESERVE 256
+
+// statically allocated, response is written by modbus task only
+char httpRequestBuff[128];
+char httpHeaderBuff[128];
+char httpBodyBuff[2048];
+
+// client whose request line is being received or whose trace is being sent
+WiFiClient httpClient;
+bool httpClientPending = false;
+size_t httpRequestLength = 0;
+uint32_t httpClientAcceptedMillis = 0;
+
+// trace events are sent over several calls of handleHttp, range of trace indexes is taken at request
+bool httpTraceSending = false;
+uint32_t httpTraceIndex = 0;
+uint32_t httpTraceEnd = 0;
+bool httpTraceFirst = true;
+uint64_t httpTraceStartUs = 0;
+
+const char* tempSensorNames[TEMP_SENSOR_COUNT] = { "T5U", "T5L", "T3", "T4", "TP", "Th" };
+
+struct FlagName {
+    STATUS_FLAGS flag;
+    const char* name;
+};
+
+const FlagName flagNames[] = {
+    { STATUS_FLAGS::sfPowerOn, "powerOn" },
+    { STATUS_FLAGS::sfHot, "hot" },
+    { STATUS_FLAGS::sfEHeat, "eHeat" },
+    { STATUS_FLAGS::sfPump, "pump" },
+    { STATUS_FLAGS::sfVacation, "vacation" },
+    { STATUS_FLAGS::sfRestored, "restored" },
+};
+
+const char* modeName(MODE mode) {
+    const char* name = enumToString(mode);
+    // skip "MODE::" prefix
+    return (strncmp(name, "MODE::", 6) == 0) ? name + 6 : name;
+}
+
+/**
+ * Writes age in seconds, null for never.
+ */
+void writeJsonAge(FixedWriter& w, uint16_t age) {
+    if (age == UINT16_MAX) {
+        w.write("null");
+    } else {
+        w.writeUint(age);
+    }
+}
+
+void writeJsonTemp(FixedWriter& w, int8_t value, uint32_t updated, uint32_t now) {
+    w.write("{\"value\":");
+    if (value == INVALID_TEMP) {
+        w.write("null");
+    } else {
+        w.writeInt(value);
+    }
+    w.write(",\"age\":");
+    writeJsonAge(w, ageSeconds(updated, now));
+    w.write('}');
+}
+
+void writeStatusJson(FixedWriter& w, const StatusSnapshot& status, uint32_t now) {
+    w.write("{\"mode\":\"").write(modeName(status.mode)).write("\",\"modeId\":").writeUint(status.mode);
+    w.write(",\"statusAge\":");
+    writeJsonAge(w, status.getStatusAgeSeconds(now));
+    w.write(",\"flags\":{");
+    for (size_t i = 0; i < sizeof(flagNames) / sizeof(flagNames[0]); i++) {
+        if (i) {
+            w.write(',');
+        }
+        w.write('"').write(flagNames[i].name).write("\":").writeBool(status.flags & flagNames[i].flag);
+    }
+    w.write("},\"temps\":{");
+    for (int i = 0; i < TEMP_SENSOR_COUNT; i++) {
+        if (i) {
+            w.write(',');
+        }
+        w.write('"').write(tempSensorNames[i]).write("\":");
+        writeJsonTemp(w, status.temps[i], status.tempUpdated[i], now);
+    }
+    w.write("},\"tempTarget\":");
+    writeJsonTemp(w, (status.tempTarget == INT8_MIN) ? INVALID_TEMP : status.tempTarget, status.tempTargetUpdated, now);
+    w.write("}\n");
+}
+
+void writeMetric(FixedWriter& w, const char* name, const char* help) {
+    w.write("# HELP coolwex_").write(name).write(' ').write(help).write('\n');
+    w.write("# TYPE coolwex_").write(name).write(" gauge\n");
+}
+
+void writeMetricValue(FixedWriter& w, const char* name, const char* labelName, const char* labelValue, int32_t value, bool valid) {
+    w.write("coolwex_").write(name);
+    if (labelName) {
+        w.write('{').write(labelName).write("=\"").write(labelValue).write("\"}");
+    }
+    w.write(' ');
+    if (valid) {
+        w.writeInt(value);
+    } else {
+        w.write("NaN");
+    }
+    w.write('\n');
+}
+
+void writeStatusPrometheus(FixedWriter& w, const StatusSnapshot& status, uint32_t now) {
+    writeMetric(w, "display_mode", "Current display mode, value of MODE enum.");
+    writeMetricValue(w, "display_mode", nullptr, nullptr, status.mode, true);
+
+    uint16_t statusAge = status.getStatusAgeSeconds(now);
+    writeMetric(w, "status_age_seconds", "Seconds since last complete status refresh.");
+    writeMetricValue(w, "status_age_seconds", nullptr, nullptr, statusAge, statusAge != UINT16_MAX);
+
+    writeMetric(w, "flag", "Status flags.");
+    for (size_t i = 0; i < sizeof(flagNames) / sizeof(flagNames[0]); i++) {
+        writeMetricValue(w, "flag", "flag", flagNames[i].name, (status.flags & flagNames[i].flag) ? 1 : 0, true);
+    }
+
+    writeMetric(w, "temperature_celsius", "Temperature sensor value.");
+    for (int i = 0; i < TEMP_SENSOR_COUNT; i++) {
+        writeMetricValue(w, "temperature_celsius", "sensor", tempSensorNames[i], status.temps[i], status.temps[i] != INVALID_TEMP);
+    }
+    writeMetric(w, "temperature_age_seconds", "Seconds since temperature sensor value was read.");
+    for (int i = 0; i < TEMP_SENSOR_COUNT; i++) {
+        uint16_t age = ageSeconds(status.tempUpdated[i], now);
+        writeMetricValue(w, "temperature_age_seconds", "sensor", tempSensorNames[i], age, age != UINT16_MAX);
+    }
+
+    writeMetric(w, "target_temperature_celsius", "Target temperature.");
+    writeMetricValue(w, "target_temperature_celsius", nullptr, nullptr, status.tempTarget, status.tempTarget != INT8_MIN);
+    uint16_t targetAge = ageSeconds(status.tempTargetUpdated, now);
+    writeMetric(w, "target_temperature_age_seconds", "Seconds since target temperature was read.");
+    writeMetricValue(w, "target_temperature_age_seconds", nullptr, nullptr, targetAge, targetAge != UINT16_MAX);
+}
+
+void writeHistogram(FixedWriter& w, const char* name, uint32_t binUs, const uint32_t* bins) {
+    w.write(",\"").write(name).write("\":{\"binUs\":").writeUint(binUs).write(",\"counts\":[");
+    for (int i = 0; i < BUS_HISTOGRAM_BINS; i++) {
+        if (i) {
+            w.write(',');
+        }
+        w.writeUint(bins[i]);
+    }
+    w.write("]}");
+}
+
+void writeBusJson(FixedWriter& w, BusProfiler& profiler) {
+    BusProfile profile = profiler.getProfile();
+    uint32_t period[BUS_HISTOGRAM_BINS];
+    uint32_t jitter[BUS_HISTOGRAM_BINS];
+    profiler.getHistograms(period, jitter);
+    w.write("{\"frames\":").writeUint(profile.frames);
+    w.write(",\"periodAvgUs\":").writeUint(profile.periodAvgUs);
+    w.write(",\"periodMinUs\":").writeUint(profile.periodMinUs);
+    w.write(",\"periodMaxUs\":").writeUint(profile.periodMaxUs);
+    w.write(",\"jitterMaxUs\":").writeUint(profile.jitterMaxUs);
+    w.write(",\"csLowAvgUs\":").writeUint(profile.csLowAvgUs);
+    w.write(",\"clockKHz\":").writeUint(profile.clockKHz);
+    w.write(",\"completionLatencyAvgUs\":").writeUint(profile.completionLatencyAvgUs);
+    // the last bin counts all longer values
+    writeHistogram(w, "periodHistogram", BUS_PERIOD_BIN_US, period);
+    writeHistogram(w, "jitterHistogram", BUS_JITTER_BIN_US, jitter);
+    w.write("}\n");
+}
+
+// trace threads of each unit
+enum TRACE_TID {
+    ttCommand = 1,
+    ttSequence,
+    ttKeyboard,
+    ttDisplay,
+};
+
+const char* traceTidNames[] = { "", "modbus command", "key sequence", "keyboard", "display" };
+
+void writeUint64(FixedWriter& w, uint64_t value) {
+    uint32_t high = value / 1000000000;
+    uint32_t low = value % 1000000000;
+    if (high) {
+        w.writeUint(high);
+        // zero padding of low part
+        for (uint32_t order = 100000000; order > 1 && low < order; order /= 10) {
+            w.write('0');
+        }
+    }
+    w.writeUint(low);
+}
+
+void writeTraceEventStart(FixedWriter& w, const char* name, char phase, uint64_t ts, uint8_t unit, TRACE_TID tid) {
+    w.write("{\"name\":\"").write(name).write("\",\"ph\":\"").write(phase).write("\",\"ts\":");
+    writeUint64(w, ts);
+    w.write(",\"pid\":").writeUint(unit).write(",\"tid\":").writeUint(tid);
+    if (phase == 'i') {
+        w.write(",\"s\":\"t\"");
+    }
+}
+
+/**
+ * Writes trace event in Chrome trace event format, ts is in microseconds since the oldest event.
+ */
+void writeTraceEvent(FixedWriter& w, const TraceEvent& event, uint64_t ts) {
+    switch (event.type) {
+    case TRACE_EVENT::teCommandReceived:
+        writeTraceEventStart(w, enumToString((KEY_SEQUENCE)event.arg), 'B', ts, event.unit, ttCommand);
+        w.write(",\"args\":{\"value\":").writeUint(event.value).write('}');
+        break;
+    case TRACE_EVENT::teCommandRejected:
+        writeTraceEventStart(w, "rejected", 'i', ts, event.unit, ttCommand);
+        w.write(",\"args\":{\"sequence\":\"").write(enumToString((KEY_SEQUENCE)event.arg)).write("\"}");
+        break;
+    case TRACE_EVENT::teCommandPosted:
+        writeTraceEventStart(w, "posted", 'i', ts, event.unit, ttCommand);
+        break;
+    case TRACE_EVENT::teCommandResult:
+        writeTraceEventStart(w, enumToString((KEY_SEQUENCE)event.arg), 'E', ts, event.unit, ttCommand);
+        w.write(",\"args\":{\"result\":").writeBool(event.value).write('}');
+        break;
+    case TRACE_EVENT::teSequenceStarted:
+        writeTraceEventStart(w, enumToString((KEY_SEQUENCE)event.arg), 'B', ts, event.unit, ttSequence);
+        w.write(",\"args\":{\"value\":").writeUint(event.value).write('}');
+        break;
+    case TRACE_EVENT::teSequenceFinished:
+        writeTraceEventStart(w, enumToString((KEY_SEQUENCE)event.arg), 'E', ts, event.unit, ttSequence);
+        w.write(",\"args\":{\"step\":").writeUint(event.step).write('}');
+        break;
+    case TRACE_EVENT::teKeyDown:
+        writeTraceEventStart(w, enumToString((KEYS)event.arg), 'B', ts, event.unit, ttKeyboard);
+        w.write(",\"args\":{\"durationMs\":").writeUint(event.value).write('}');
+        break;
+    case TRACE_EVENT::teKeyUp:
+        writeTraceEventStart(w, enumToString((KEYS)event.arg), 'E', ts, event.unit, ttKeyboard);
+        break;
+    case TRACE_EVENT::teStepConfirmed:
+        writeTraceEventStart(w, enumToString((MODE)event.arg), 'i', ts, event.unit, ttDisplay);
+        w.write(",\"args\":{\"step\":").writeUint(event.step).write('}');
+        break;
+    }
+    w.write('}');
+}
+
+/**
+ * Appends already received part of request line "GET /path HTTP/1.1" to httpRequestBuff without waiting for the rest.
+ * Rest of request is ignored.
+ * @return true when the whole line has been received
+ */
+bool readRequestLine(WiFiClient& client) {
+    while (client.available() > 0) {
+        int c = client.read();
+        if (c < 0) {
+            break;
+        }
+        if (c == '\r' || c == '\n') {
+            httpRequestBuff[httpRequestLength] = '\0';
+            return true;
+        }
+        if (httpRequestLength + 1 < sizeof(httpRequestBuff)) {
+            httpRequestBuff[httpRequestLength++] = c;
+        }
+    }
+    return false;
+}
+
+/**
+ * Matches request line "GET /path[?unit=n] HTTP/1.1" against "GET /path" and returns requested unit, the first one
+ * by default.
+ */
+HeatPumpUnit* matchRequest(const char* request, const char* methodPath) {
+    size_t len = strlen(methodPath);
+    if (strncmp(request, methodPath, len) != 0) {
+        return nullptr;
+    }
+    const char* rest = request + len;
+    int index = 0;
+    if (strncmp(rest, "?unit=", 6) == 0) {
+        rest += 6;
+        if (!isdigit(*rest)) {
+            return nullptr;
+        }
+        index = *rest++ - '0';
+    }
+    if (*rest != ' ' || index >= UNIT_COUNT) {
+        return nullptr;
+    }
+    return &units[index];
+}
+
+void sendResponse(WiFiClient& client, const char* status, const char* contentType, FixedWriter& body) {
+    FixedWriter header(httpHeaderBuff, sizeof(httpHeaderBuff));
+    header.write("HTTP/1.1 ").write(status).write("\r\nContent-Type: ").write(contentType);
+    header.write("\r\nContent-Length: ").writeUint(body.getLength()).write("\r\nConnection: close\r\n\r\n");
+    client.write((const uint8_t*)header.getBuffer(), header.getLength());
+    client.write((const uint8_t*)body.getBuffer(), body.getLength());
+}
+
+/**
+ * Sends header and metadata of command trace in Chrome trace format (chrome://tracing, Perfetto). Events follow
+ * by sendTraceChunk, so the response has no content length.
+ */
+void startTrace(WiFiClient& client) {
+    FixedWriter header(httpHeaderBuff, sizeof(httpHeaderBuff));
+    header.write("HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nConnection: close\r\n\r\n");
+    client.write((const uint8_t*)header.getBuffer(), header.getLength());
+
+    FixedWriter body(httpBodyBuff, sizeof(httpBodyBuff));
+    body.write("{\"traceEvents\":[");
+    for (int unit = 0; unit < UNIT_COUNT; unit++) {
+        body.write("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":").writeUint(unit);
+        body.write(",\"args\":{\"name\":\"unit ").writeUint(unit).write("\"}},");
+        for (int tid = ttCommand; tid <= ttDisplay; tid++) {
+            body.write("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":").writeUint(unit).write(",\"tid\":").writeUint(tid);
+            body.write(",\"args\":{\"name\":\"").write(traceTidNames[tid]).write("\"}},");
+        }
+    }
+    client.write((const uint8_t*)body.getBuffer(), body.getLength());
+
+    httpTraceSending = true;
+    httpTraceIndex = commandTrace.getFirstIndex();
+    httpTraceEnd = commandTrace.getEndIndex();
+    httpTraceFirst = true;
+}
+
+/**
+ * Sends trace events which fit body buffer, so modbus requests are served between chunks.
+ * @return true when the last chunk has been sent
+ */
+bool sendTraceChunk(WiFiClient& client) {
+    FixedWriter body(httpBodyBuff, sizeof(httpBodyBuff));
+    // events overwritten since the previous chunk are skipped
+    httpTraceIndex = max(httpTraceIndex, commandTrace.getFirstIndex());
+    TraceEvent event;
+    for (; httpTraceIndex < httpTraceEnd && body.getLength() + HTTP_CHUNK_RESERVE <= sizeof(httpBodyBuff); httpTraceIndex++) {
+        if (!commandTrace.get(httpTraceIndex, event)) {
+            // overwritten while sending
+            continue;
+        }
+        if (httpTraceFirst) {
+            httpTraceStartUs = event.timeUs;
+        } else {
+            body.write(',');
+        }
+        httpTraceFirst = false;
+        writeTraceEvent(body, event, event.timeUs - httpTraceStartUs);
+    }
+    bool done = httpTraceIndex >= httpTraceEnd;
+    if (done) {
+        body.write("]}\n");
+    }
+    client.write((const uint8_t*)body.getBuffer(), body.getLength());
+    return done;
+}
+
+void initializeHttp() {
+    httpServer.begin();
+    httpServer.setNoDelay(true);
+}
+
+/**
+ * Sends response to received request line.
+ */
+void serveRequest(WiFiClient& client) {
+    FixedWriter body(httpBodyBuff, sizeof(httpBodyBuff));
+    uint32_t now = timeSource->millis();
+    HeatPumpUnit* unit;
+    if ((unit = matchRequest(httpRequestBuff, "GET /status"))) {
+        writeStatusJson(body, unit->stateData.getSnapshot(), now);
+        sendResponse(client, "200 OK", "application/json", body);
+    } else if ((unit = matchRequest(httpRequestBuff, "GET /metrics"))) {
+        writeStatusPrometheus(body, unit->stateData.getSnapshot(), now);
+        sendResponse(client, "200 OK", "text/plain; version=0.0.4", body);
+    } else if ((unit = matchRequest(httpRequestBuff, "GET /bus"))) {
+        writeBusJson(body, unit->busProfiler);
+        sendResponse(client, "200 OK", "application/json", body);
+    } else if (strncmp(httpRequestBuff, "GET /trace ", 11) == 0) {
+        startTrace(client);
+    } else {
+        body.write("Not found\n");
+        sendResponse(client, "404 Not Found", "text/plain", body);
+    }
+    if (body.isOverflow()) {
+        Serial.printf("ERR: HTTP response truncated\n");
+    }
+}
+
+/**
+ * Serves HTTP clients one at a time without blocking. Called periodically by modbus task, request line of accepted
+ * client is collected and trace is sent over several calls.
+ *
+ * GET /status returns status as JSON, GET /metrics in Prometheus text format. Status of other than the first unit
+ * is requested by "?unit=n" query. GET /trace returns trace of recent commands of all units. GET /bus returns
+ * display bus timing profile of a unit.
+ */
+void handleHttp() {
+    if (httpTraceSending) {
+        if (httpClient.connected() && !sendTraceChunk(httpClient)) {
+            return;
+        }
+        httpTraceSending = false;
+        httpClient.stop();
+        httpClientPending = false;
+        return;
+    }
+
+    if (!httpClientPending) {
+        if (!httpServer.hasClient()) {
+            return;
+        }
+        httpClient = httpServer.available();
+        if (!httpClient) {
+            return;
+        }
+        httpClientPending = true;
+        httpRequestLength = 0;
+        httpClientAcceptedMillis = timeSource->millis();
+    }
+
+    if (readRequestLine(httpClient)) {
+        serveRequest(httpClient);
+        if (httpTraceSending) {
+            // trace events are sent by next calls
+            return;
+        }
+    } else if (timeSource->millis() - httpClientAcceptedMillis < HTTP_REQUEST_TIMEOUT_MS && httpClient.connected()) {
+        // wait for the rest of request line
+        return;
+    }
+    httpClient.stop();
+    httpClientPending = false;
+}
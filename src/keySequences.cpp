@@ -1,44 +1,125 @@
 #include <Arduino.h>
 #include "common.h"
 #include "keySequences.h"
+#include "commandTrace.h"
+#include "navigation.h"
 
+/**
+ * Max number of presses reverting function triggered by too short press during calibration.
+ */
+#define CALIBRATION_MAX_REVERTS 2
 
-bool checkDisplayMode(MODE expMode) {
+const PressCalibration pressCalibrations[PRESS_ACTION_COUNT] = {
+    { KEYS::keyDownArrow, MODE::unlocked, MODE::setTemp, KEYS::keyCancel, PRESS_ACTION::paTap, 100, 20, 20, 1000 },
+    { KEYS::keyEHeaterPlusDisinfect, MODE::unlocked, MODE::infoT5U, KEYS::keyEHeaterPlusDisinfect, PRESS_ACTION::paInfoToggle, 1100, 100, 200, 5000 },
+    { KEYS::keyEnter, MODE::locked, MODE::unlocked, KEYS::keyEnter, PRESS_ACTION::paUnlock, 3200, 100, 500, 10000 },
+};
+
+KeyboardSequence::KeyboardSequence(uint8_t unitIndex, Keyboard& keyboard, StateData& stateData)
+    : unitIndex(unitIndex), keyboard(keyboard), stateData(stateData) {
+    for (int i = 0; i < PRESS_ACTION_COUNT; i++) {
+        pressDurations[i] = pressCalibrations[i].defaultMs;
+    }
+}
+
+void KeyboardSequence::setPressDurations(const uint16_t* durations) {
+    for (int i = 0; i < PRESS_ACTION_COUNT; i++) {
+        pressDurations[i] = durations[i];
+    }
+}
+
+bool KeyboardSequence::setPressDuration(PRESS_ACTION action, uint16_t durationMs) {
+    const PressCalibration& calibration = pressCalibrations[action];
+    if (durationMs < calibration.minMs || durationMs > calibration.maxMs) {
+        Serial.printf("ERR: duration %d of action %d is out of range <%d;%d>\n", (int)durationMs, action,
+            (int)calibration.minMs, (int)calibration.maxMs);
+        return false;
+    }
+    if (pressDurations[action] != durationMs) {
+        pressDurations[action] = durationMs;
+        pressDurationsChanged = true;
+    }
+    return true;
+}
+
+
+bool KeyboardSequence::checkDisplayMode(MODE expMode) {
     MODE currentMode = stateData.getDisplayMode();
     if (currentMode != expMode) {
         Serial.printf("ERR: %s expected, but it is: %s\n", enumToString(expMode), enumToString(currentMode));
+        stepCheckFailed = true;
         return false;
     }
+    if (currentSequenceStep < SEQUENCE_MAX_STEPS) {
+        verifiedStepModes[currentSequenceStep] = expMode;
+    }
+    commandTrace.record(TRACE_EVENT::teStepConfirmed, unitIndex, expMode, 0, currentSequenceStep);
     return true;
 }
 
-bool KeyboardSequence::checkDisplayModeAndDoNextStep(MODE expMode, KEYS key, uint16_t durationMs) {
+bool KeyboardSequence::checkDisplayModeAndDoNextStep(MODE expMode, KEYS key, PRESS_ACTION action) {
     if (!checkDisplayMode(expMode)) {
         return false;
     }
     currentSequenceStep++;
-    keyboard.keyDown(key, durationMs);
+    pressKey(key, action);
     return true;
 }
 
+/**
+ * Presses the first key of the cheapest path from current display mode to target mode. Cost of a press is its
+ * duration and settle time of display after it.
+ */
+NAVIGATION_RESULT KeyboardSequence::navigateTo(MODE targetMode) {
+    MODE currentMode = stateData.getDisplayMode();
+    if (currentMode == navigationExpectedMode) {
+        // the last press reached planned mode
+        navigationPresses = 0;
+    }
+    navigationExpectedMode = MODE::unknown;
+    if (currentMode == targetMode) {
+        navigationPresses = 0;
+        return checkDisplayMode(targetMode) ? NAVIGATION_RESULT::nrArrived : NAVIGATION_RESULT::nrFailed;
+    }
+
+    uint32_t settleMs = (uint32_t)tuning.get(TUNING_PARAM::tpSettleReads) * tuning.get(TUNING_PARAM::tpDisplayPeriodMs);
+    uint32_t actionCosts[PRESS_ACTION_COUNT];
+    for (int i = 0; i < PRESS_ACTION_COUNT; i++) {
+        actionCosts[i] = pressDurations[i] + settleMs;
+    }
+    const NavigationEdge* edge = planNextEdge(currentMode, targetMode, actionCosts);
+    if (!edge) {
+        // not logged, calibration waits for display to lock itself this way
+        return NAVIGATION_RESULT::nrFailed;
+    }
+    if (navigationPresses >= NAVIGATION_MAX_PRESSES) {
+        Serial.printf("ERR: %s not reached, %d presses missed\n", enumToString(targetMode), navigationPresses);
+        navigationPresses = 0;
+        return NAVIGATION_RESULT::nrFailed;
+    }
+    navigationPresses++;
+    navigationExpectedMode = edge->to;
+    pressKey(edge->key, edge->action);
+    return NAVIGATION_RESULT::nrMoving;
+}
+
 bool KeyboardSequence::commonGetStateSteps0to3() {
     bool isSetVacationMode;
     switch (currentSequenceStep) {
     case 0:
-        currentSequenceStep++;
-        if (stateData.getDisplayMode() == MODE::displayOff) {
-            // press cancel to turn display on
-            keyboard.keyDown(KEYS::keyCancel, 100);
-            return true;
-        }
     case 1:
-        currentSequenceStep++;
-        if (stateData.getDisplayMode() == MODE::locked) {
-            keyboard.keyDown(KEYS::keyEnter, 3200);
+        // turn display on, unlock it or leave other screen
+        switch (navigateTo(MODE::unlocked)) {
+        case NAVIGATION_RESULT::nrMoving:
             return true;
+        case NAVIGATION_RESULT::nrFailed:
+            stepCheckFailed = true;
+            return false;
+        default:
+            currentSequenceStep = 2;
         }
     case 2:
-        return checkDisplayModeAndDoNextStep(MODE::unlocked, KEYS::keyVacation, 100);
+        return checkDisplayModeAndDoNextStep(MODE::unlocked, KEYS::keyVacation, paTap);
     case 3:
         currentSequenceStep++;
         // setVacation mode is available only if power is on
@@ -46,7 +127,7 @@ bool KeyboardSequence::commonGetStateSteps0to3() {
         stateData.setPowerOn(isSetVacationMode);
 
         if (isSetVacationMode) {
-            keyboard.keyDown(KEYS::keyCancel, 100);
+            pressKey(KEYS::keyCancel, paTap);
             return true;
         }
         if (!checkDisplayMode(MODE::unlocked)) {
@@ -79,10 +160,10 @@ bool KeyboardSequence::keySequencePowerOn(bool targetPowerOnValue) {
         }
 
         currentSequenceStep++;
-        keyboard.keyDown(KEYS::keyOnOff, 100);
+        pressKey(KEYS::keyOnOff, paTap);
         return true;
     case 5:
-        return checkDisplayModeAndDoNextStep(MODE::unlocked, KEYS::keyVacation, 100);
+        return checkDisplayModeAndDoNextStep(MODE::unlocked, KEYS::keyVacation, paTap);
     case 6:
         currentSequenceStep++;
         // vacation mode is available only if power is on
@@ -95,7 +176,7 @@ bool KeyboardSequence::keySequencePowerOn(bool targetPowerOnValue) {
             Serial.printf("ERR: failed to set power %s\n", boolAsOnOffStr(targetPowerOnValue));
         }
         if (isSetVacationMode) {
-            keyboard.keyDown(KEYS::keyCancel, 100);
+            pressKey(KEYS::keyCancel, paTap);
             return true;
         }
     case 7:
@@ -109,26 +190,30 @@ bool KeyboardSequence::keySequenceSetTargetTemp(int8_t targetTemp) {
     Serial.printf("keySequenceSetTargetTemp(s:%d, v:%d)\n", currentSequenceStep, targetTemp);
     switch (currentSequenceStep) {
     case 0:
+        // power state is not needed, setTemp is reached directly from any screen
+        switch (navigateTo(MODE::setTemp)) {
+        case NAVIGATION_RESULT::nrMoving:
+            return true;
+        case NAVIGATION_RESULT::nrFailed:
+            stepCheckFailed = true;
+            return false;
+        default:
+            currentSequenceStep++;
+        }
     case 1:
-    case 2:
-    case 3:
-        return commonGetStateSteps0to3();
-    case 4:
-        return checkDisplayModeAndDoNextStep(MODE::unlocked, KEYS::keyUpArrow, 100);
-    case 5:
         if (!checkDisplayMode(MODE::setTemp)) {
             return false;
         }
 
         Serial.printf(" %d -> %d\n", stateData.getCurrentSetTempValue(), targetTemp);
         if (stateData.getCurrentSetTempValue() == targetTemp) {
-            keyboard.keyDown(KEYS::keyEnter, 100);
+            pressKey(KEYS::keyEnter, paTap);
             currentSequenceStep++;
         } else {
-            keyboard.keyDown((stateData.getCurrentSetTempValue() < targetTemp) ? KEYS::keyUpArrow : KEYS::keyDownArrow, 100);
+            pressKey((stateData.getCurrentSetTempValue() < targetTemp) ? KEYS::keyUpArrow : KEYS::keyDownArrow, paTap);
         }
         return true;
-    case 6:
+    case 2:
         if (!checkDisplayMode(MODE::unlocked)) {
             return false;
         }
@@ -150,9 +235,44 @@ bool KeyboardSequence::keySequenceRefreshStatus() {
     case 3:
         return commonGetStateSteps0to3();
     case 4:
-        return checkDisplayModeAndDoNextStep(MODE::unlocked, KEYS::keyDownArrow, 100);
     case 5:
-        if (checkDisplayModeAndDoNextStep(MODE::setTemp, KEYS::keyCancel, 100)) {
+    case 6:
+    case 7:
+        return readTempTargetSteps(4);
+    case 8:
+        return checkDisplayModeAndDoNextStep(MODE::unlocked, KEYS::keyEHeaterPlusDisinfect, paInfoToggle);
+    case 9:
+        return checkDisplayModeAndDoNextStep(MODE::infoT5U, KEYS::keyDownArrow, paTap);
+    case 10:
+        return checkDisplayModeAndDoNextStep(MODE::infoT5L, KEYS::keyDownArrow, paTap);
+    case 11:
+        return checkDisplayModeAndDoNextStep(MODE::infoT3, KEYS::keyDownArrow, paTap);
+    case 12:
+        return checkDisplayModeAndDoNextStep(MODE::infoT4, KEYS::keyDownArrow, paTap);
+    case 13:
+        return checkDisplayModeAndDoNextStep(MODE::infoTP, KEYS::keyDownArrow, paTap);
+    case 14:
+        return checkDisplayModeAndDoNextStep(MODE::infoTh, KEYS::keyEHeaterPlusDisinfect, paInfoToggle);
+    case 15:
+        Serial.println("INFO: status read completed");
+        stateData.onStatusUpdated();
+        return false;
+    default:
+        Serial.println("ERR: unexpected status sequence step");
+        return false;
+    }
+}
+
+/**
+ * Reads target temperature via setTemp screen in 4 steps starting at firstStep in unlocked mode, display is returned
+ * to unlocked mode at step firstStep + 4.
+ */
+bool KeyboardSequence::readTempTargetSteps(uint8_t firstStep) {
+    switch (currentSequenceStep - firstStep) {
+    case 0:
+        return checkDisplayModeAndDoNextStep(MODE::unlocked, KEYS::keyDownArrow, paTap);
+    case 1:
+        if (checkDisplayModeAndDoNextStep(MODE::setTemp, KEYS::keyCancel, paTap)) {
             if (stateData.getCurrentSetTempValue() == 38) {
                 // 38 is the lowest possible value. Not sure if the real target value is 38 or 39 decreased by down arrow
                 // try to get value via up arrow in next 2 steps
@@ -164,53 +284,242 @@ bool KeyboardSequence::keySequenceRefreshStatus() {
             return true;
         }
         return false;
-    case 6:
-        return checkDisplayModeAndDoNextStep(MODE::unlocked, KEYS::keyUpArrow, 100);
-    case 7:
-        if (checkDisplayModeAndDoNextStep(MODE::setTemp, KEYS::keyCancel, 100)) {
+    case 2:
+        return checkDisplayModeAndDoNextStep(MODE::unlocked, KEYS::keyUpArrow, paTap);
+    case 3:
+        if (checkDisplayModeAndDoNextStep(MODE::setTemp, KEYS::keyCancel, paTap)) {
             stateData.setTempTarget(stateData.getCurrentSetTempValue() - 1);
             return true;
         }
         return false;
-    case 8:
-        return checkDisplayModeAndDoNextStep(MODE::unlocked, KEYS::keyEHeaterPlusDisinfect, 1100);
-    case 9:
-        return checkDisplayModeAndDoNextStep(MODE::infoT5U, KEYS::keyDownArrow, 100);
-    case 10:
-        return checkDisplayModeAndDoNextStep(MODE::infoT5L, KEYS::keyDownArrow, 100);
-    case 11:
-        return checkDisplayModeAndDoNextStep(MODE::infoT3, KEYS::keyDownArrow, 100);
-    case 12:
-        return checkDisplayModeAndDoNextStep(MODE::infoT4, KEYS::keyDownArrow, 100);
-    case 13:
-        return checkDisplayModeAndDoNextStep(MODE::infoTP, KEYS::keyDownArrow, 100);
-    case 14:
-        return checkDisplayModeAndDoNextStep(MODE::infoTh, KEYS::keyEHeaterPlusDisinfect, 1100);
-    case 15:
-        Serial.println("INFO: status read completed");
-        stateData.onStatusUpdated();
+    default:
+        Serial.println("ERR: unexpected target temp step");
+        return false;
+    }
+}
+
+/**
+ * Refreshes single value in background. Temperature is decoded as soon as its info screen is shown, target
+ * temperature is read the same way as by keySequenceRefreshStatus. Display is left unlocked.
+ */
+bool KeyboardSequence::keySequenceRefreshValue(uint8_t index) {
+    Serial.printf("keySequenceRefreshValue(s:%d, v:%d)\n", currentSequenceStep, index);
+    MODE valueMode = (index == REFRESH_VALUE_TEMP_TARGET) ? MODE::unlocked : (MODE)(MODE::infoT5U + index);
+    switch (currentSequenceStep) {
+    case 0:
+        switch (navigateTo(valueMode)) {
+        case NAVIGATION_RESULT::nrMoving:
+            return true;
+        case NAVIGATION_RESULT::nrFailed:
+            stepCheckFailed = true;
+            return false;
+        default:
+            currentSequenceStep++;
+        }
+    case 1:
+    case 2:
+    case 3:
+    case 4:
+        if (index == REFRESH_VALUE_TEMP_TARGET) {
+            return readTempTargetSteps(1);
+        }
+        switch (navigateTo(MODE::unlocked)) {
+        case NAVIGATION_RESULT::nrMoving:
+            return true;
+        case NAVIGATION_RESULT::nrFailed:
+            stepCheckFailed = true;
+            return false;
+        default:
+            Serial.printf("INFO: value %d refreshed\n", index);
+            return false;
+        }
+    case 5:
+        if (checkDisplayMode(MODE::unlocked)) {
+            Serial.printf("INFO: value %d refreshed\n", index);
+        }
         return false;
     default:
-        Serial.println("ERR: unexpected status sequence step");
+        Serial.println("ERR: unexpected refresh value step");
+        return false;
+    }
+}
+
+bool KeyboardSequence::keySequencePressKey(uint16_t keyAndDuration) {
+    Serial.printf("keySequencePressKey(s:%d, v:%d)\n", currentSequenceStep, keyAndDuration);
+    switch (currentSequenceStep) {
+    case 0:
+        currentSequenceStep++;
+        keyboard.keyDown((KEYS)(keyAndDuration >> 8), (keyAndDuration & 0xFF) * 100);
+        return true;
+    case 1:
+        // key released
+        return false;
+    default:
+        Serial.println("ERR: unexpected press key sequence step");
+        return false;
+    }
+}
+
+/**
+ * Searches for the shortest reliable duration of each press action. Duration is accepted after CALIBRATION_TRIALS
+ * successful presses in a row, search ends when difference of failing and working duration is within resolution.
+ * Result is increased by 25 % safety margin, but never above the default.
+ *
+ * Steps: 0 - bring display to fromMode and press with trial duration, 1 - evaluate trial and return display
+ * to fromMode, 2 - revert E-heater switched by too short press.
+ */
+bool KeyboardSequence::keySequenceCalibrate() {
+    const PressCalibration& calibration = pressCalibrations[calibratedAction];
+    MODE mode = stateData.getDisplayMode();
+    switch (currentSequenceStep) {
+    case 0:
+        if (navigateTo(calibration.fromMode) == NAVIGATION_RESULT::nrArrived) {
+            Serial.printf("keySequenceCalibrate(a:%d, %d ms)\n", calibratedAction, calibrationTrialMs);
+            calibrationFlagsBefore = stateData.getStatusFlags();
+            currentSequenceStep++;
+            keyboard.keyDown(calibration.key, calibrationTrialMs);
+            return true;
+        }
+        if (stateData.millisSince(calibrationWaitStartMillis) > CALIBRATION_LOCK_WAIT_MS) {
+            Serial.printf("ERR: %s not reached, calibration of action %d skipped\n",
+                enumToString(calibration.fromMode), calibratedAction);
+            return finishActionCalibration();
+        }
+        // moving, or waiting for display to lock itself as there is no key locking it
+        return true;
+    case 1:
+        if (mode == calibration.toMode) {
+            if (calibration.fromMode != MODE::locked) {
+                pressKey(calibration.backKey, calibration.backAction);
+            }
+            return onCalibrationTrialDone(true);
+        }
+        if (mode != calibration.fromMode) {
+            Serial.printf("ERR: unexpected %s during calibration\n", enumToString(mode));
+            return false;
+        }
+        currentSequenceStep++;
+        calibrationReverts = 0;
+    case 2:
+        // short press of keyEHeaterPlusDisinfect can switch E-heater
+        if ((stateData.getStatusFlags() ^ calibrationFlagsBefore) & STATUS_FLAGS::sfEHeat) {
+            if (calibrationReverts++ >= CALIBRATION_MAX_REVERTS) {
+                Serial.printf("ERR: failed to revert E-heater during calibration\n");
+                return false;
+            }
+            pressKey(calibration.key, PRESS_ACTION::paTap);
+            return true;
+        }
+        return onCalibrationTrialDone(false);
+    default:
+        Serial.println("ERR: unexpected calibration step");
         return false;
     }
 }
 
+void KeyboardSequence::startActionCalibration(PRESS_ACTION action) {
+    calibratedAction = action;
+    calibrationLowMs = 0;
+    calibrationHighMs = pressCalibrations[action].defaultMs;
+    calibrationTrialMs = calibrationHighMs / 2;
+    calibrationSuccesses = 0;
+    currentSequenceStep = 0;
+    calibrationWaitStartMillis = stateData.getNow();
+}
+
+/**
+ * Moves binary search of calibrated action after a trial.
+ * @return false if calibration is finished
+ */
+bool KeyboardSequence::onCalibrationTrialDone(bool success) {
+    const PressCalibration& calibration = pressCalibrations[calibratedAction];
+    currentSequenceStep = 0;
+    calibrationWaitStartMillis = stateData.getNow();
+    if (success) {
+        if (++calibrationSuccesses < CALIBRATION_TRIALS) {
+            return true;
+        }
+        calibrationHighMs = calibrationTrialMs;
+    } else {
+        calibrationLowMs = calibrationTrialMs;
+    }
+    if (calibrationHighMs - calibrationLowMs > calibration.resolutionMs) {
+        calibrationTrialMs = (calibrationLowMs + calibrationHighMs) / 2;
+        calibrationSuccesses = 0;
+        return true;
+    }
+
+    uint32_t result = calibrationHighMs + calibrationHighMs / 4;
+    if (result > calibration.defaultMs) {
+        result = calibration.defaultMs;
+    }
+    Serial.printf("INFO: action %d calibrated to %d ms (was %d ms)\n", calibratedAction, (int)result,
+        (int)pressDurations[calibratedAction]);
+    pressDurations[calibratedAction] = result;
+    pressDurationsChanged = true;
+    return finishActionCalibration();
+}
+
+bool KeyboardSequence::finishActionCalibration() {
+    if (calibratedAction + 1 < PRESS_ACTION_COUNT) {
+        startActionCalibration((PRESS_ACTION)(calibratedAction + 1));
+        return true;
+    }
+    Serial.printf("INFO: calibration completed\n");
+    return false;
+}
+
+void KeyboardSequence::startRequestedCalibration() {
+    if (calibrationRequested && currentSequence == KEY_SEQUENCE::ksNone
+        && commandState.load(std::memory_order_acquire) == COMMAND_STATE::csIdle
+        && startKeySequence(KEY_SEQUENCE::ksCalibrate, 0))
+    {
+        startActionCalibration(PRESS_ACTION::paTap);
+    }
+}
+
+void KeyboardSequence::startRequestedRefresh() {
+    uint8_t requests = refreshRequests;
+    if (!requests || currentSequence != KEY_SEQUENCE::ksNone
+        || commandState.load(std::memory_order_acquire) != COMMAND_STATE::csIdle)
+    {
+        return;
+    }
+    uint8_t index = 0;
+    while (!(requests & (1 << index))) {
+        index++;
+    }
+    startKeySequence(KEY_SEQUENCE::ksRefreshValue, index);
+}
+
+void KeyboardSequence::requestValueRefresh(uint8_t index) {
+    if (refreshFailures & (1 << index)) {
+        uint32_t holdOffMs = tuning.get(TUNING_PARAM::tpStaleReadS) * 1000UL;
+        if (timeSource->millis() - refreshFailedMillis[index] < holdOffMs) {
+            return;
+        }
+        refreshFailures.fetch_and(~(1 << index));
+    }
+    refreshRequests.fetch_or(1 << index);
+}
 
 bool KeyboardSequence::onLoop() {
+    processCommand();
+
     if (keyboard.isKeyDown()) {
         displayReadsAfterKeyUp = 0;
         // Serial.printf("keyDown: %ld, %d\n", keyboard.getKeyDownDurationMillis(), keyboard.isKeyDown());
         return true;
     }
 
-    if (displayReadsAfterKeyUp < 3) {
+    if (displayReadsAfterKeyUp < tuning.get(TUNING_PARAM::tpSettleReads)) {
         // let few loops pause after key up to refresh display
         // Serial.printf("to early after key up: %d\n", displayReadsAfterKeyUp);
         return false;
     }
 
     bool callResult = false;
+    stepCheckFailed = false;
     switch (currentSequence) {
     case KEY_SEQUENCE::ksNone:
         return false;
@@ -223,15 +532,77 @@ bool KeyboardSequence::onLoop() {
     case KEY_SEQUENCE::ksSetTargetTemp:
         callResult = keySequenceSetTargetTemp(currentSequenceTargetValue);
         break;
+    case KEY_SEQUENCE::ksPressKey:
+        callResult = keySequencePressKey(currentSequenceTargetValue);
+        break;
+    case KEY_SEQUENCE::ksCalibrate:
+        callResult = keySequenceCalibrate();
+        break;
+    case KEY_SEQUENCE::ksRefreshValue:
+        callResult = keySequenceRefreshValue(currentSequenceTargetValue);
+        break;
     default:
         Serial.printf("ERR: Unexpected key sequence\n");
     }
     if (!callResult) {
+        if (stepCheckFailed && tryResumeSequence()) {
+            return false;
+        }
+        if (stepCheckFailed && currentSequence == KEY_SEQUENCE::ksRefreshValue) {
+            // cancelled refresh clears its request, hold off the next one
+            refreshFailedMillis[currentSequenceTargetValue] = timeSource->millis();
+            refreshFailures.fetch_or(1 << currentSequenceTargetValue);
+        }
         cancelCurrentSequence();
     }
     return callResult;
 }
 
+/**
+ * Re-synchronises failed sequence with current display mode. Sequence continues from the last step which has
+ * already verified the current mode in this run, so lost key press is repeated and extra one is walked back
+ * without losing progress. Display turned off or locked in the middle of sequence restarts it from step 0, as does
+ * any unverified mode in sequences which navigate to their screen in step 0.
+ */
+bool KeyboardSequence::tryResumeSequence() {
+    uint8_t failedStep = currentSequenceStep;
+    uint8_t statStep = (failedStep < SEQUENCE_MAX_STEPS) ? failedStep : SEQUENCE_MAX_STEPS - 1;
+    if (!retriesLeft) {
+        stepAbortCount[statStep]++;
+        Serial.printf("ERR: no retries left, step %d failed\n", failedStep);
+        return false;
+    }
+
+    MODE currentMode = stateData.getDisplayMode();
+    int resumeStep = -1;
+    if (currentMode == MODE::displayOff || currentMode == MODE::locked) {
+        resumeStep = 0;
+    } else {
+        for (int i = statStep; i >= 0; i--) {
+            if (verifiedStepModes[i] == currentMode) {
+                resumeStep = i;
+                break;
+            }
+        }
+    }
+    if (resumeStep < 0 && (currentSequence == KEY_SEQUENCE::ksSetTargetTemp || currentSequence == KEY_SEQUENCE::ksRefreshValue)) {
+        // step 0 of these sequences navigates to their screen from any mode
+        resumeStep = 0;
+    }
+    if (resumeStep < 0) {
+        stepAbortCount[statStep]++;
+        Serial.printf("ERR: cannot resume step %d from %s\n", failedStep, enumToString(currentMode));
+        return false;
+    }
+
+    retriesLeft--;
+    stepRetryCount[statStep]++;
+    currentSequenceStep = resumeStep;
+    Serial.printf("INFO: step %d resumed from step %d (%s), retries left: %d\n",
+        failedStep, resumeStep, enumToString(currentMode), retriesLeft);
+    return true;
+}
+
 bool KeyboardSequence::startKeySequence(KEY_SEQUENCE sequence, uint16_t targetValue) {
     Serial.printf("startKeySequence(seq: %d, val: %d)\n", sequence, targetValue);
     if (currentSequence != KEY_SEQUENCE::ksNone) {
@@ -241,27 +612,105 @@ bool KeyboardSequence::startKeySequence(KEY_SEQUENCE sequence, uint16_t targetVa
     currentSequence = sequence;
     currentSequenceTargetValue = targetValue;
     currentSequenceStep = 0;
+    navigationPresses = 0;
+    navigationExpectedMode = MODE::unknown;
+    commandTrace.record(TRACE_EVENT::teSequenceStarted, unitIndex, sequence, targetValue);
+    retriesLeft = SEQUENCE_MAX_RETRIES;
+    for (int i = 0; i < SEQUENCE_MAX_STEPS; i++) {
+        verifiedStepModes[i] = MODE::unknown;
+    }
     return true;
 }
 
 bool KeyboardSequence::processKeySequence(KEY_SEQUENCE sequence, uint16_t targetValue, uint16_t timeoutMs) {
-    if (!startKeySequence(sequence, targetValue)) {
+    uint8_t expectedState = COMMAND_STATE::csIdle;
+    if (!commandState.compare_exchange_strong(expectedState, COMMAND_STATE::csClaimed)) {
+        commandTrace.record(TRACE_EVENT::teCommandRejected, unitIndex, sequence, targetValue);
+        Serial.printf("ERR: Another key sequence in progress\n");
         return false;
     }
-    uint32_t startTime = stateData.getNow();
-    while (getCurrentSequence() == sequence) {
+    commandTrace.record(TRACE_EVENT::teCommandReceived, unitIndex, sequence, targetValue);
+    commandSequence = sequence;
+    commandTargetValue = targetValue;
+    commandAbandoned = false;
+    commandState.store(COMMAND_STATE::csPosted, std::memory_order_release);
+    commandTrace.record(TRACE_EVENT::teCommandPosted, unitIndex, sequence);
+
+    uint32_t startTime = timeSource->millis();
+    while (commandState.load(std::memory_order_acquire) != COMMAND_STATE::csDone) {
         // Serial.printf("waiting for sequence\n");
-        delay(50);
-        if (stateData.getNow() > startTime + timeoutMs) {
+        timeSource->delay(50);
+        if (timeSource->millis() - startTime > timeoutMs) {
             Serial.printf("ERR: Sequence timeout!\n");
-            cancelCurrentSequence();
+            // display task cancels the sequence and releases the slot
+            commandAbandoned = true;
+            releaseAbandonedCommand();
+            commandTrace.record(TRACE_EVENT::teCommandResult, unitIndex, sequence, 0);
             return false;
         }
     }
-    return true;
+    bool result = commandResult;
+    commandState.store(COMMAND_STATE::csIdle, std::memory_order_release);
+    commandTrace.record(TRACE_EVENT::teCommandResult, unitIndex, sequence, result);
+    return result;
+}
+
+/**
+ * Starts posted command or cancels abandoned one. Called by display task only.
+ */
+void KeyboardSequence::processCommand() {
+    switch (commandState.load(std::memory_order_acquire)) {
+    case COMMAND_STATE::csPosted:
+        if (currentSequence == KEY_SEQUENCE::ksRefreshValue) {
+            // background refresh gives way to client command, it is requested again by the next stale read
+            cancelCurrentSequence();
+        }
+        if (commandAbandoned) {
+            finishCommand(false);
+        } else if (startKeySequence(commandSequence, commandTargetValue)) {
+            commandState.store(COMMAND_STATE::csRunning, std::memory_order_release);
+        } else {
+            finishCommand(false);
+        }
+        break;
+    case COMMAND_STATE::csRunning:
+        if (commandAbandoned) {
+            Serial.printf("ERR: Sequence abandoned\n");
+            cancelCurrentSequence();
+        }
+        break;
+    }
+}
+
+void KeyboardSequence::finishCommand(bool result) {
+    // requester reads status right after completion
+    stateData.publish();
+    commandResult = result;
+    commandState.store(COMMAND_STATE::csDone);
+    if (commandAbandoned) {
+        releaseAbandonedCommand();
+    }
+}
+
+void KeyboardSequence::releaseAbandonedCommand() {
+    // called by both sides, the one which comes later releases the slot
+    uint8_t expectedState = COMMAND_STATE::csDone;
+    commandState.compare_exchange_strong(expectedState, COMMAND_STATE::csIdle);
 }
 
 void KeyboardSequence::cancelCurrentSequence() {
+    if (currentSequence == KEY_SEQUENCE::ksCalibrate) {
+        calibrationRequested = false;
+    }
+    if (currentSequence == KEY_SEQUENCE::ksRefreshValue) {
+        refreshRequests.fetch_and(~(1 << currentSequenceTargetValue));
+    }
+    if (currentSequence != KEY_SEQUENCE::ksNone) {
+        commandTrace.record(TRACE_EVENT::teSequenceFinished, unitIndex, currentSequence, 0, currentSequenceStep);
+    }
     currentSequence = KEY_SEQUENCE::ksNone;
     currentSequenceStep = 0;
-}
\ No newline at end of file
+    if (commandState.load(std::memory_order_acquire) == COMMAND_STATE::csRunning) {
+        finishCommand(true);
+    }
+}
@@ -1,16 +1,38 @@
 #include "keyboard.h"
+#include "commandTrace.h"
 
 void Keyboard::setKeyboardOutPinsAsInputs() {
-    pinMode(PIN_KEYBOARD_OUT_COL_1, INPUT);
-    pinMode(PIN_KEYBOARD_OUT_COL_2, INPUT);
-    pinMode(PIN_KEYBOARD_OUT_COL_3, INPUT);
+    pinMode(pins.outCols[0], INPUT);
+    pinMode(pins.outCols[1], INPUT);
+    pinMode(pins.outCols[2], INPUT);
 }
-uint8_t keyColumnPins[] = { PIN_KEYBOARD_OUT_COL_1, PIN_KEYBOARD_OUT_COL_2, PIN_KEYBOARD_OUT_COL_3 };
 
-Keyboard::Keyboard() {
+bool Keyboard::resetStuckOutPins() {
+    if (isKeyDown()) {
+        return false;
+    }
+    for (auto pin : pins.outCols) {
+        if (GPIO_FAST_IS_OUTPUT(pin)) {
+            Serial.printf("ERR: keyboard pin %d of unit %d stuck as output\n", (int)pin, (int)unitIndex);
+            setKeyboardOutPinsAsInputs();
+            return true;
+        }
+    }
+    return false;
+}
+
+Keyboard::Keyboard(uint8_t unitIndex, StateData& stateData, const KeyboardPins& pins)
+    : unitIndex(unitIndex), stateData(stateData), pins(pins) {
     Serial.printf("Keyboard init: %ld\n", keyDownDurationMillis);
 }
 
+void Keyboard::initializePins() {
+    pinMode(pins.inRows[0], INPUT_PULLUP);
+    pinMode(pins.inRows[1], INPUT_PULLUP);
+    pinMode(pins.inRows[2], INPUT_PULLUP);
+    setKeyboardOutPinsAsInputs();
+}
+
 void Keyboard::keyDown(KEYS key, uint16_t durationMs) {
     uint8_t col = key >> 4;
     uint8_t row = key & 0x0F;
@@ -25,13 +47,15 @@ void Keyboard::keyDown(KEYS key, uint16_t durationMs) {
     }
     setKeyboardOutPinsAsInputs();
 
-    outPin = keyColumnPins[col];
+    outPin = pins.outCols[col];
     inRow = row;
     pinMode(outPin, OUTPUT);
     GPIO_FAST_OUTPUT_ENABLE(outPin);
 
     keyDownAtMillis = stateData.getNow();
     keyDownDurationMillis = durationMs;
+    keyDownKey = key;
+    commandTrace.record(TRACE_EVENT::teKeyDown, unitIndex, key, durationMs);
 }
 
 void Keyboard::onLoop() {
@@ -47,5 +71,6 @@ void Keyboard::onLoop() {
 
         Serial.printf("keyUp(now: %d, keyDownAtMillis: %d, keyDownDurationMillis: %d)\n", stateData.getNow(), keyDownAtMillis, keyDownDurationMillis);
         keyDownDurationMillis = 0;
+        commandTrace.record(TRACE_EVENT::teKeyUp, unitIndex, keyDownKey);
     }
 }
\ No newline at end of file
@@ -6,191 +6,120 @@
 #include <freertos/task.h>
 #include <driver/spi_slave.h>
 #include <driver/gpio.h>
-#include <ESPmDNS.h>
 
+#include "commandTrace.h"
 #include "common.h"
-#include "keySequences.h"
-
-#define WIFI_SSID "XXXX"
-#define WIFI_PASSWORD "YYYY"
-
-
-ModbusIP modbus;
-StateData stateData(modbus);
-uint32_t lastWiFiReconnectMillis = 0;
-uint32_t lastTransactionStartedMillis = 0;
-
-bool displayDataReady = false;
-bool spiTransactionStared = false;
-
-Keyboard keyboard;
-KeyboardSequence keyboardSequence(keyboard);
-
-void initializeSpiSlave();
-bool handleDisplayDataReady();
-
-void IRAM_ATTR keyboadPulseInt() {
-    keyboard.onKeyboardInputRow1Low();
-}
+#include "heatPumpUnit.h"
+#include "resourceMonitor.h"
+
+
+ModbusIPServer modbus;
+
+const UnitPins unitPins[] = {
+    {
+        VSPI_HOST, PIN_DISPLAY_CS, PIN_DISPLAY_CLK, PIN_DISPLAY_DATA,
+        {
+            { PIN_KEYBOARD_IN_ROW_1, PIN_KEYBOARD_IN_ROW_2, PIN_KEYBOARD_IN_ROW_3 },
+            { PIN_KEYBOARD_OUT_COL_1, PIN_KEYBOARD_OUT_COL_2, PIN_KEYBOARD_OUT_COL_3 },
+        },
+    },
+    {
+        HSPI_HOST, PIN_UNIT2_DISPLAY_CS, PIN_UNIT2_DISPLAY_CLK, PIN_UNIT2_DISPLAY_DATA,
+        {
+            { PIN_UNIT2_KEYBOARD_IN_ROW_1, PIN_UNIT2_KEYBOARD_IN_ROW_2, PIN_UNIT2_KEYBOARD_IN_ROW_3 },
+            { PIN_UNIT2_KEYBOARD_OUT_COL_1, PIN_UNIT2_KEYBOARD_OUT_COL_2, PIN_UNIT2_KEYBOARD_OUT_COL_3 },
+        },
+    },
+};
 
-void initializeWiFi() {
-    // WiFi.enableLongRange(true);
-    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
-
-    uint16_t connectWait = 240;
-    while (WiFi.status() != WL_CONNECTED) {
-        delay(250);
-        Serial.printf(".");
-        if (!connectWait--) {
-            Serial.printf("Failed to connect, restarting!\n");
-            ESP.restart();
-        }
-    }
+HeatPumpUnit units[UNIT_COUNT] = {
+    { 0, unitPins[0] },
+#if UNIT_COUNT > 1
+    { 1, unitPins[1] },
+#endif
+};
 
-    Serial.printf("\nWiFi connected, IP address: ");
-    Serial.println(WiFi.localIP());
-    if (!MDNS.begin("boiler")) {   // Set the hostname to "esp32.local"
-        Serial.println("Error setting up MDNS responder!");
-    }
-    Serial.println("mDNS responder started");
-}
+JitterMeter displayTaskJitter(DISPLAY_TASK_PERIOD_MS);
+CommandTrace commandTrace;
+Tuning tuning;
+ResourceMonitor resourceMonitor;
+uint16_t recoveryRestarts = 0;
 
 void modbusTask(void* pvParameters) {
     while (true) {
 //        Serial.println("*** MODBUS ***");
-        modbus.task();
-        delay(100);
+        modbus.waitForRequest(tuning.get(TUNING_PARAM::tpModbusIdleMs));
+        modbus.serve();
+        handleHttp();
+        verifyWiFiConnected();
+        persistStatus();
+        resourceMonitor.sample();
         yield();
     }
 }
 
-void setup() {
-    pinMode(PIN_KEYBOARD_IN_ROW_1, INPUT_PULLUP);
-    pinMode(PIN_KEYBOARD_IN_ROW_2, INPUT_PULLUP);
-    pinMode(PIN_KEYBOARD_IN_ROW_3, INPUT_PULLUP);
-
-    keyboard.setKeyboardOutPinsAsInputs();
-
-    Serial.begin(921600);
-    Serial.println("\nStarted, connecting WiFi");
-
-    initializeWiFi();
-
-    initializeModbus();
-
-    attachInterrupt(PIN_KEYBOARD_IN_ROW_1, keyboadPulseInt, FALLING);
-    initializeSpiSlave();
-    xTaskCreate(modbusTask, "modbusTask", 4096, NULL, 1, NULL);
-}
-
-spi_slave_transaction_t spiReadTransaction = {
-    .length = 137,
-    .rx_buffer = displayBuff,
-};
-
-void IRAM_ATTR displayDataReceived(spi_slave_transaction_t* t) {
-    spiTransactionStared = false;
-    displayDataReady = true;
-}
-
-void initializeSpiSlave() {
-    pinMode(PIN_DISPLAY_CS, INPUT_PULLDOWN);
-    pinMode(PIN_DISPLAY_CLK, INPUT_PULLDOWN);
-    pinMode(PIN_DISPLAY_DATA, INPUT_PULLDOWN);
-
-    spi_bus_config_t bcfg = {
-        .mosi_io_num = PIN_DISPLAY_DATA,
-        .miso_io_num = -1,
-        .sclk_io_num = PIN_DISPLAY_CLK,
-    };
-    spi_slave_interface_config_t scfg = {
-        .spics_io_num = PIN_DISPLAY_CS,
-        .flags = 0,
-        .queue_size = 1,
-        .mode = 2,
-        .post_trans_cb = displayDataReceived,
-    };
-
-    esp_err_t spi_state = spi_slave_initialize(VSPI_HOST, &bcfg, &scfg, SPI_DMA_DISABLED);
-    if (spi_state != ESP_OK) {
-        Serial.printf("SPI initialsation failed!\n");
+void displayTask(void* pvParameters) {
+    for (auto& unit : units) {
+        unit.initializeDisplay();
     }
-}
 
-void verifyWiFiConnected() {
-    if ((WiFi.status() != WL_CONNECTED) && (stateData.millisSince(lastWiFiReconnectMillis) >= 30000)) {
-        Serial.printf("Reconnecting to WiFi...\n");
-        WiFi.disconnect();
-        WiFi.reconnect();
-        lastWiFiReconnectMillis = stateData.getNow();
+    TickType_t lastWakeTime = xTaskGetTickCount();
+    while (true) {
+        uint16_t periodMs = tuning.get(TUNING_PARAM::tpDisplayPeriodMs);
+        vTaskDelayUntil(&lastWakeTime, pdMS_TO_TICKS(periodMs));
+        displayTaskJitter.setNominalPeriodMs(periodMs);
+        displayTaskJitter.onWake();
+        // units are handled one after another, so their key sequences run concurrently
+        for (auto& unit : units) {
+            unit.displayLoop();
+        }
+        autoTuneBusTiming();
+        displayTaskJitter.onIterationDone();
     }
 }
 
-// uint32_t lastPrintMillis = 0;
+// unit tests built with sources have their own setup and loop
+#ifndef PIO_UNIT_TESTING
+void setup() {
+    for (auto& unit : units) {
+        unit.initializePins();
+    }
 
+    Serial.begin(921600);
+    Serial.println("\nStarted");
 
-void loop() {
-    stateData.onLoopStart();
-    // if (stateData.millisSince(lastPrintMillis) > 100) {
-    //     // Serial.println("L");
-    //     lastPrintMillis = stateData.getNow();
-    // }
-    delay(30);
-    
-    keyboard.onLoop();
-    if (keyboardSequence.onLoop()) {
-        // key is down, no more actions
-        return;
-    }
-    verifyWiFiConnected();
+    restoreTuning();
+    restoreRecoveryRestarts();
 
-    // process data from display
-    if (displayDataReady) {
-        displayDataReady = false;
-        if (!handleDisplayDataReady()) {
-            return;
-        }
-        keyboardSequence.afterDisplayDataRead();
+    // clients get last known status until it is refreshed
+    for (auto& unit : units) {
+        unit.setBootRefreshPending(!restoreStatus(unit));
+        restorePressDurations(unit);
+        restoreSchedule(unit);
     }
 
-    if (stateData.millisSince(lastTransactionStartedMillis) > 5000 && spiTransactionStared) {
-        spiTransactionStared = false;
-        Serial.printf("Read display SPI transaction time out!\n");
-    }
+    // display is read and modbus served while WiFi connects in background
+    initializeWiFi();
 
-    // start new read display transaction
-    if (!spiTransactionStared && GPIO_FAST_GET_LEVEL(PIN_DISPLAY_CS)) {
-        esp_err_t spi_state = spi_slave_queue_trans(VSPI_HOST, &spiReadTransaction, portMAX_DELAY);
-        if (spi_state == ESP_OK) {
-            spiTransactionStared = true;
-            lastTransactionStartedMillis = stateData.getNow();
-        } else {
-            Serial.printf("SPI trans failed!\n");
-        }
-    }
+    initializeModbus();
+    initializeHttp();
+
+    TaskHandle_t handle;
+    xTaskCreatePinnedToCore(displayTask, "displayTask", DISPLAY_TASK_STACK_SIZE, NULL, DISPLAY_TASK_PRIORITY, &handle, DISPLAY_TASK_CORE);
+    resourceMonitor.setTask(MONITORED_TASK::mtDisplayTask, handle);
+    xTaskCreatePinnedToCore(modbusTask, "modbusTask", MODBUS_TASK_STACK_SIZE, NULL, MODBUS_TASK_PRIORITY, &handle, NETWORK_TASK_CORE);
+    resourceMonitor.setTask(MONITORED_TASK::mtModbusTask, handle);
+#if MODBUS_RTU_ENABLED
+    xTaskCreatePinnedToCore(modbusRtuTask, "modbusRtuTask", MODBUS_RTU_TASK_STACK_SIZE, NULL, MODBUS_RTU_TASK_PRIORITY, &handle, NETWORK_TASK_CORE);
+    resourceMonitor.setTask(MONITORED_TASK::mtModbusRtuTask, handle);
+#endif
+    xTaskCreatePinnedToCore(scheduleTask, "scheduleTask", SCHEDULE_TASK_STACK_SIZE, NULL, SCHEDULE_TASK_PRIORITY, &handle, NETWORK_TASK_CORE);
+    resourceMonitor.setTask(MONITORED_TASK::mtScheduleTask, handle);
 }
 
-bool handleDisplayDataReady() {
-    spi_slave_transaction_t* trans;
-    if (spi_slave_get_trans_result(VSPI_HOST, &trans, portMAX_DELAY) != ESP_OK) {
-        Serial.printf("ERR: Failed to get transaction result\n");
-        return false;
-    }
-    uint8_t* data = (uint8_t*)spiReadTransaction.rx_buffer;
-    if (spiReadTransaction.trans_len == 137 && data[0] == 0b10100000) {
-        // printData(data, 18 * 8);
-        for (int i = 0; i < 16; i++) {
-            data[i] = (data[i + 1] << 1);
-            if (data[i + 2] & 0x80) {
-                data[i] += 1;
-            }
-        }
-        decodeDisplayData();
-    } else {
-        Serial.printf("SPI receive failed. Len=%d; header=%d\n", spiReadTransaction.trans_len, (int)data[0]);
-        printData(data, 18 * 8);
-        return false;
-    }
-    return true;
+void loop() {
+    // all work is done by displayTask and modbusTask, stack used by setup is kept for diagnostics
+    resourceMonitor.sampleCurrentTask(MONITORED_TASK::mtLoopTask);
+    vTaskDelete(NULL);
 }
-
+#endif
@@ -1,14 +1,28 @@
 #include <Arduino.h>
 #include "common.h"
-#include "keySequences.h"
+#include "heatPumpUnit.h"
+#include "resourceMonitor.h"
+#if MODBUS_RTU_ENABLED
+#include <ModbusRTU.h>
+#endif
 
-extern KeyboardSequence keyboardSequence;
+#if MODBUS_RTU_ENABLED
+ModbusRTU modbusRtu;
+#endif
+
+/**
+ * Returns unit which owns the register.
+ */
+HeatPumpUnit& unitOf(TRegister* reg) {
+    return units[unitIndexOfRegister(reg->address.address)];
+}
 
 uint16_t onSetRefreshStatusCallback(TRegister* reg, uint16_t value) {
     Serial.printf("onSetRefreshStatusCallback(v:%d)\n", (int)value);
+    HeatPumpUnit& unit = unitOf(reg);
 
-    if (keyboardSequence.processKeySequence(KEY_SEQUENCE::ksRefreshStatus, 0, 10000)
-        && stateData.getStatusAgeSeconds() == 0)
+    if (unit.keyboardSequence.processKeySequence(KEY_SEQUENCE::ksRefreshStatus, 0, tuning.get(TUNING_PARAM::tpRefreshTimeoutMs))
+        && unit.stateData.getSnapshot().getStatusAgeSeconds(timeSource->millis()) == 0)
     {
         return value;
     } else {
@@ -19,9 +33,10 @@ uint16_t onSetRefreshStatusCallback(TRegister* reg, uint16_t value) {
 
 uint16_t onSetPowerOnCallback(TRegister* reg, uint16_t value) {
     Serial.printf("onSetPowerOnCallback(v:%s)\n", boolAsOnOffStr(value));
+    HeatPumpUnit& unit = unitOf(reg);
 
-    if (keyboardSequence.processKeySequence(KEY_SEQUENCE::ksPowerOn, value, 7000)
-        && ((bool)value) == stateData.isPowerOn())
+    if (unit.keyboardSequence.processKeySequence(KEY_SEQUENCE::ksPowerOn, value, tuning.get(TUNING_PARAM::tpPowerOnTimeoutMs))
+        && ((bool)value) == (bool)(unit.stateData.getSnapshot().flags & STATUS_FLAGS::sfPowerOn))
     {
         return value;
     } else {
@@ -32,30 +47,26 @@ uint16_t onSetPowerOnCallback(TRegister* reg, uint16_t value) {
 
 uint16_t onSetPressKeyCallback(TRegister* reg, uint16_t value) {
     Serial.printf("onSetPressKeyCallback(v:%d)\n", (int)value);
-    KEYS key = (KEYS)(value >> 8);
+    HeatPumpUnit& unit = unitOf(reg);
     uint16_t durationMs = (value & 0xFF) * 100;
-    keyboard.keyDown(key, durationMs);
 
     // wait for keyUp
-    uint32_t startTime = stateData.getNow();
-    while (keyboard.isKeyDown()) {
-        delay(50);
-        if (stateData.getNow() > startTime + durationMs + 500) {
-            Serial.printf("ERR: press key timeout!\n");
-            return 0xFFFF;;
-        }
+    if (!unit.keyboardSequence.processKeySequence(KEY_SEQUENCE::ksPressKey, value, durationMs + tuning.get(TUNING_PARAM::tpPressKeyMarginMs))) {
+        Serial.printf("ERR: press key timeout!\n");
+        return 0xFFFF;
     }
     return value;
 }
 
 uint16_t onSetTempTargetCallback(TRegister* reg, uint16_t value) {
     uint8_t targetTemp = value - 128;
+    HeatPumpUnit& unit = unitOf(reg);
     Serial.printf("onSetTempTargetCallback(v:%d)\n", (int)targetTemp);
     if (targetTemp < 38 || targetTemp > 60) {
         Serial.printf("ERR: target temp %d is out of range <38;60>\n", (int)targetTemp);
     } else {
-        if (keyboardSequence.processKeySequence(KEY_SEQUENCE::ksSetTargetTemp, targetTemp, 13000)
-            && stateData.getTempTarget() == targetTemp)
+        if (unit.keyboardSequence.processKeySequence(KEY_SEQUENCE::ksSetTargetTemp, targetTemp, tuning.get(TUNING_PARAM::tpSetTempTimeoutMs))
+            && unit.stateData.getSnapshot().tempTarget == targetTemp)
         {
             Serial.printf("Target temp successfully set to %d\n", targetTemp);
         } else {
@@ -65,38 +76,270 @@ uint16_t onSetTempTargetCallback(TRegister* reg, uint16_t value) {
     return value;
 }
 
-uint16_t onGetTempTargetCallback(TRegister* reg, uint16_t value) {
-    return stateData.getTempTarget() + 128;
+/**
+ * Returns cached value and requests its background refresh if it is older than hregTuneStaleReadS.
+ */
+uint16_t onGetStaleValueCallback(TRegister* reg, uint16_t value) {
+    uint16_t staleReadS = tuning.get(TUNING_PARAM::tpStaleReadS);
+    if (!staleReadS) {
+        return value;
+    }
+    HeatPumpUnit& unit = unitOf(reg);
+    uint16_t address = registerWithinUnit(reg->address.address);
+    uint8_t index = (address == MODBUS_REGISTERS::hregTempTarget) ? REFRESH_VALUE_TEMP_TARGET : address - MODBUS_REGISTERS::iregTempT5U;
+    StatusSnapshot status = unit.stateData.getSnapshot();
+    uint32_t updated = (index == REFRESH_VALUE_TEMP_TARGET) ? status.tempTargetUpdated : status.tempUpdated[index];
+    if (ageSeconds(updated, timeSource->millis()) >= staleReadS) {
+        unit.keyboardSequence.requestValueRefresh(index);
+    }
+    return value;
+}
+
+/**
+ * Copies last published status to register storage. Called by task of each modbus server before serving requests,
+ * so all registers of one request come from the same snapshot. Callbacks must be disabled.
+ */
+void applyStatusSnapshot(Modbus& mb, HeatPumpUnit& unit) {
+    uint16_t base = unitRegisterBase(unit.getIndex());
+    StatusSnapshot status = unit.stateData.getSnapshot();
+    mb.Ireg(base + MODBUS_REGISTERS::iregDisplayMode, status.mode);
+    mb.Ireg(base + MODBUS_REGISTERS::iregStatusAge, status.getStatusAgeSeconds(timeSource->millis()));
+    mb.Ireg(base + MODBUS_REGISTERS::iregStatusFlags, status.flags);
+    for (int i = 0; i < TEMP_SENSOR_COUNT; i++) {
+        mb.Ireg(base + MODBUS_REGISTERS::iregTempT5U + i, status.temps[i] + 128);
+    }
+    for (int i = 0; i < INFO_VALUE_COUNT; i++) {
+        mb.Ireg(base + MODBUS_REGISTERS::iregInfoCE + i, status.infoValues[i]);
+    }
+    mb.Hreg(base + MODBUS_REGISTERS::hregTempTarget, status.tempTarget + 128);
+    mb.Coil(base + MODBUS_REGISTERS::cregPowerOn, status.flags & STATUS_FLAGS::sfPowerOn);
+
+    for (int i = 0; i < PRESS_ACTION_COUNT; i++) {
+        uint16_t durationMs = unit.keyboardSequence.getPressDuration((PRESS_ACTION)i);
+        mb.Ireg(base + MODBUS_REGISTERS::iregPressTapMs + i, durationMs);
+        mb.Hreg(base + MODBUS_REGISTERS::hregTunePressTapMs + i, durationMs);
+    }
+    if (unit.getIndex() == 0) {
+        for (int i = 0; i < TUNING_PARAM_COUNT; i++) {
+            mb.Hreg(MODBUS_REGISTERS::hregTuneDisplayPeriodMs + i, tuning.get((TUNING_PARAM)i));
+        }
+    }
+
+    ScheduleEntry entries[SCHEDULE_MAX_ENTRIES];
+    unit.schedule.getEntries(entries);
+    for (int i = 0; i < SCHEDULE_MAX_ENTRIES; i++) {
+        for (int field = 0; field < SCHEDULE_ENTRY_REGISTERS; field++) {
+            mb.Hreg(base + MODBUS_REGISTERS::hregScheduleDays + i * SCHEDULE_ENTRY_REGISTERS + field, entries[i].fields[field]);
+        }
+    }
+}
+
+/**
+ * Sets 32-bit value to two input registers, high word first.
+ */
+void setIreg32(Modbus& mb, uint16_t address, uint32_t value) {
+    mb.Ireg(address, value >> 16);
+    mb.Ireg(address + 1, value & 0xFFFF);
+}
+
+uint32_t ageSeconds32(uint32_t sinceMillis, uint32_t nowMillis) {
+    return sinceMillis ? (nowMillis - sinceMillis) / 1000 : UINT32_MAX;
+}
+
+uint16_t limitToUint16(uint32_t value) {
+    return (value > UINT16_MAX) ? UINT16_MAX : value;
+}
+
+void applyDutyStats(Modbus& mb, HeatPumpUnit& unit) {
+    uint32_t now = timeSource->millis();
+    DutySnapshot duty = unit.dutyStats.getSnapshot();
+    for (int i = 0; i < DUTY_FLAG_COUNT; i++) {
+        const FlagStats& flag = duty.flags[i];
+        uint16_t base = unitRegisterBase(unit.getIndex()) + i * DUTY_REGISTER_STRIDE;
+        setIreg32(mb, base + MODBUS_REGISTERS::iregDutyHotOnSeconds, flag.onSeconds);
+        setIreg32(mb, base + MODBUS_REGISTERS::iregDutyHotCycles, flag.cycles);
+        setIreg32(mb, base + MODBUS_REGISTERS::iregDutyHotLastOnAge, ageSeconds32(flag.lastOnMillis, now));
+        setIreg32(mb, base + MODBUS_REGISTERS::iregDutyHotLastOffAge, ageSeconds32(flag.lastOffMillis, now));
+        mb.Ireg(base + MODBUS_REGISTERS::iregDutyHotHour, flag.dutyShort);
+        mb.Ireg(base + MODBUS_REGISTERS::iregDutyHotDay, flag.dutyLong);
+    }
+}
+
+void applyDiagnostics(Modbus& mb, HeatPumpUnit& unit) {
+    uint16_t base = unitRegisterBase(unit.getIndex());
+    mb.Ireg(base + MODBUS_REGISTERS::iregDisplayTaskJitterMax, limitToUint16(displayTaskJitter.getJitterMaxUs()));
+    mb.Ireg(base + MODBUS_REGISTERS::iregDisplayTaskJitterAvg, limitToUint16(displayTaskJitter.getJitterAvgUs()));
+    mb.Ireg(base + MODBUS_REGISTERS::iregDisplayTaskBusyMax, limitToUint16(displayTaskJitter.getBusyMaxUs()));
+    mb.Ireg(base + MODBUS_REGISTERS::iregDisplayTaskJitterMaxEver, limitToUint16(displayTaskJitter.getJitterMaxEverUs()));
+
+    for (int i = 0; i < PIPELINE_COUNTER_COUNT; i++) {
+        setIreg32(mb, base + MODBUS_REGISTERS::iregFramesReceived + 2 * i, unit.pipelineCounters.get((PIPELINE_COUNTER)i));
+    }
+
+    mb.Ireg(base + MODBUS_REGISTERS::iregRecoveryFaults, unit.getFaultsInRow());
+    for (int i = 0; i < SEQUENCE_MAX_STEPS; i++) {
+        mb.Ireg(base + MODBUS_REGISTERS::iregStepRetries + i, unit.keyboardSequence.getStepRetryCount(i));
+        mb.Ireg(base + MODBUS_REGISTERS::iregStepAborts + i, unit.keyboardSequence.getStepAbortCount(i));
+    }
+    BusProfile bus = unit.busProfiler.getProfile();
+    uint32_t busValues[] = { bus.periodAvgUs, bus.periodMinUs, bus.periodMaxUs, bus.jitterMaxUs, bus.csLowAvgUs,
+        bus.clockKHz, bus.completionLatencyAvgUs };
+    for (size_t i = 0; i < sizeof(busValues) / sizeof(busValues[0]); i++) {
+        mb.Ireg(base + MODBUS_REGISTERS::iregBusFramePeriodAvgUs + i, limitToUint16(busValues[i]));
+    }
+
+    if (unit.getIndex() == 0) {
+        for (int i = 0; i < MONITORED_TASK_COUNT; i++) {
+            mb.Ireg(MODBUS_REGISTERS::iregStackFreeLoopTask + i, limitToUint16(resourceMonitor.getStackFree((MONITORED_TASK)i)));
+        }
+        mb.Ireg(MODBUS_REGISTERS::iregRecoveryRestarts, recoveryRestarts);
+        uint32_t heap[] = { resourceMonitor.getHeapFree(), resourceMonitor.getHeapLargestBlock(), resourceMonitor.getHeapMinFree() };
+        for (int i = 0; i < 3; i++) {
+            setIreg32(mb, MODBUS_REGISTERS::iregHeapFree + 2 * i, heap[i]);
+        }
+    }
+}
+
+uint16_t onSetResetDiagnosticsCallback(TRegister* reg, uint16_t value) {
+    Serial.printf("onSetResetDiagnosticsCallback(v:%d)\n", (int)value);
+    // counters are applied to registers of all servers before their next serving round
+    HeatPumpUnit& unit = unitOf(reg);
+    unit.pipelineCounters.reset();
+    unit.busProfiler.reset();
+    return value;
+}
+
+uint16_t onSetTuningCallback(TRegister* reg, uint16_t value) {
+    TUNING_PARAM param = (TUNING_PARAM)(reg->address.address - MODBUS_REGISTERS::hregTuneDisplayPeriodMs);
+    Serial.printf("onSetTuningCallback(%s, v:%d)\n", tuningParams[param].name, (int)value);
+    // invalid value is replaced by the current one
+    return tuning.set(param, value) ? value : tuning.get(param);
+}
+
+uint16_t onSetTunePressCallback(TRegister* reg, uint16_t value) {
+    HeatPumpUnit& unit = unitOf(reg);
+    PRESS_ACTION action = (PRESS_ACTION)(registerWithinUnit(reg->address.address) - MODBUS_REGISTERS::hregTunePressTapMs);
+    Serial.printf("onSetTunePressCallback(a:%d, v:%d)\n", action, (int)value);
+    return unit.keyboardSequence.setPressDuration(action, value) ? value : unit.keyboardSequence.getPressDuration(action);
 }
 
-uint16_t onGetStatusAgeCallback(TRegister* reg, uint16_t value) {
-    Serial.printf("onGetStatusAgeCallback(a:%d)\n", (int)reg->address.address);
-    return stateData.getStatusAgeSeconds();
+uint16_t onSetScheduleCallback(TRegister* reg, uint16_t value) {
+    HeatPumpUnit& unit = unitOf(reg);
+    uint16_t offset = registerWithinUnit(reg->address.address) - MODBUS_REGISTERS::hregScheduleDays;
+    uint8_t entry = offset / SCHEDULE_ENTRY_REGISTERS;
+    SCHEDULE_FIELD field = (SCHEDULE_FIELD)(offset % SCHEDULE_ENTRY_REGISTERS);
+    Serial.printf("onSetScheduleCallback(e:%d, f:%d, v:%d)\n", (int)entry, field, (int)value);
+    // invalid value is replaced by the current one
+    return unit.schedule.setField(entry, field, value) ? value : unit.schedule.getField(entry, field);
+}
+
+uint16_t onSetCalibrateKeyPressesCallback(TRegister* reg, uint16_t value) {
+    Serial.printf("onSetCalibrateKeyPressesCallback(v:%s)\n", boolAsOnOffStr(value));
+    if (value) {
+        unitOf(reg).keyboardSequence.requestCalibration();
+    }
+    return value;
 }
 
-uint16_t onGetStatusFlagsCallback(TRegister* reg, uint16_t value) {
-    uint16_t res = 0;
-    if (stateData.isPowerOn()) res += STATUS_FLAGS::sfPowerOn;
-    if (stateData.isHot()) res += STATUS_FLAGS::sfHot;
-    if (stateData.isEHeat()) res += STATUS_FLAGS::sfEHeat;
-    if (stateData.isPump()) res += STATUS_FLAGS::sfPump;
-    if (stateData.isVacation()) res += STATUS_FLAGS::sfVacation;
-    Serial.printf("onGetStatusFlagsCallback(a:%d, res:%d)\n", (int)reg->address.address, res);
-    return res;
+/**
+ * Reads calibration state on request, so the coil is never written by the setter which would request calibration.
+ */
+uint16_t onGetCalibrateKeyPressesCallback(TRegister* reg, uint16_t value) {
+    return COIL_VAL(unitOf(reg).keyboardSequence.isCalibrating());
+}
+
+void applyRegisterValues(Modbus& mb) {
+    // setters would invoke onSet callbacks of written registers and start key sequences
+    mb.cbDisable();
+    for (auto& unit : units) {
+        applyStatusSnapshot(mb, unit);
+        applyDiagnostics(mb, unit);
+        applyDutyStats(mb, unit);
+    }
+    mb.cbEnable();
+}
+
+void applyTcpRegisterValues() {
+    applyRegisterValues(modbus);
+}
+
+/**
+ * Adds registers and callbacks of unit.
+ */
+void registerUnitModbusMap(Modbus& mb, HeatPumpUnit& unit) {
+    uint16_t base = unitRegisterBase(unit.getIndex());
+    mb.addIreg(base + MODBUS_REGISTERS::iregDisplayMode, 0, MODBUS_REGISTERS::iregTempTh - MODBUS_REGISTERS::iregDisplayMode + 1);
+    mb.addIreg(base + MODBUS_REGISTERS::iregInfoCE, 0, INFO_VALUE_COUNT);
+    mb.addHreg(base + MODBUS_REGISTERS::hregTempTarget, 0, 1);
+    mb.addHreg(base + MODBUS_REGISTERS::hregPressKey, 0, 1);
+    mb.addCoil(base + MODBUS_REGISTERS::cregRefreshStatus, false, 1);
+    mb.addCoil(base + MODBUS_REGISTERS::cregPowerOn, false, 1);
+    mb.onSetHreg(base + MODBUS_REGISTERS::hregPressKey, onSetPressKeyCallback, 1);
+    mb.onSetHreg(base + MODBUS_REGISTERS::hregTempTarget, onSetTempTargetCallback, 1);
+    mb.onSetCoil(base + MODBUS_REGISTERS::cregRefreshStatus, onSetRefreshStatusCallback, 1);
+    mb.onSetCoil(base + MODBUS_REGISTERS::cregPowerOn, onSetPowerOnCallback, 1);
+    mb.onGetIreg(base + MODBUS_REGISTERS::iregTempT5U, onGetStaleValueCallback, TEMP_SENSOR_COUNT);
+    mb.onGetHreg(base + MODBUS_REGISTERS::hregTempTarget, onGetStaleValueCallback, 1);
+    mb.addIreg(base + MODBUS_REGISTERS::iregDisplayTaskJitterMax, 0, MODBUS_REGISTERS::iregDisplayTaskJitterMaxEver - MODBUS_REGISTERS::iregDisplayTaskJitterMax + 1);
+    mb.addIreg(base + MODBUS_REGISTERS::iregFramesReceived, 0, 2 * PIPELINE_COUNTER_COUNT);
+    mb.addIreg(base + MODBUS_REGISTERS::iregRecoveryFaults, 0, 1);
+    mb.addIreg(base + MODBUS_REGISTERS::iregStepRetries, 0, SEQUENCE_MAX_STEPS);
+    mb.addIreg(base + MODBUS_REGISTERS::iregStepAborts, 0, SEQUENCE_MAX_STEPS);
+    mb.addIreg(base + MODBUS_REGISTERS::iregDutyHotOnSeconds, 0, DUTY_FLAG_COUNT * DUTY_REGISTER_STRIDE);
+    mb.addIreg(base + MODBUS_REGISTERS::iregBusFramePeriodAvgUs, 0, MODBUS_REGISTERS::iregBusCompletionLatencyUs - MODBUS_REGISTERS::iregBusFramePeriodAvgUs + 1);
+    mb.addCoil(base + MODBUS_REGISTERS::cregResetDiagnostics, false, 1);
+    mb.onSetCoil(base + MODBUS_REGISTERS::cregResetDiagnostics, onSetResetDiagnosticsCallback, 1);
+    mb.addIreg(base + MODBUS_REGISTERS::iregPressTapMs, 0, PRESS_ACTION_COUNT);
+    mb.addCoil(base + MODBUS_REGISTERS::cregCalibrateKeyPresses, false, 1);
+    mb.onSetCoil(base + MODBUS_REGISTERS::cregCalibrateKeyPresses, onSetCalibrateKeyPressesCallback, 1);
+    mb.onGetCoil(base + MODBUS_REGISTERS::cregCalibrateKeyPresses, onGetCalibrateKeyPressesCallback, 1);
+    mb.addHreg(base + MODBUS_REGISTERS::hregTunePressTapMs, 0, PRESS_ACTION_COUNT);
+    mb.onSetHreg(base + MODBUS_REGISTERS::hregTunePressTapMs, onSetTunePressCallback, PRESS_ACTION_COUNT);
+    mb.addHreg(base + MODBUS_REGISTERS::hregScheduleDays, 0, SCHEDULE_MAX_ENTRIES * SCHEDULE_ENTRY_REGISTERS);
+    mb.onSetHreg(base + MODBUS_REGISTERS::hregScheduleDays, onSetScheduleCallback, SCHEDULE_MAX_ENTRIES * SCHEDULE_ENTRY_REGISTERS);
+    if (unit.getIndex() == 0) {
+        // timing parameters, stacks and heap are common for all units
+        mb.addHreg(MODBUS_REGISTERS::hregTuneDisplayPeriodMs, 0, TUNING_PARAM_COUNT);
+        mb.onSetHreg(MODBUS_REGISTERS::hregTuneDisplayPeriodMs, onSetTuningCallback, TUNING_PARAM_COUNT);
+        mb.addIreg(MODBUS_REGISTERS::iregStackFreeLoopTask, 0, MONITORED_TASK_COUNT);
+        mb.addIreg(MODBUS_REGISTERS::iregRecoveryRestarts, 0, 1);
+        mb.addIreg(MODBUS_REGISTERS::iregHeapFree, 0, MODBUS_REGISTERS::iregHeapMinFree - MODBUS_REGISTERS::iregHeapFree + 2);
+    }
+}
+
+/**
+ * Adds registers and callbacks shared by all modbus servers.
+ */
+void registerModbusMap(Modbus& mb) {
+    for (auto& unit : units) {
+        registerUnitModbusMap(mb, unit);
+    }
 }
 
 void initializeModbus() {
     modbus.server();
-    modbus.addIreg(MODBUS_REGISTERS::iregDisplayMode, 0, MODBUS_REGISTERS::iregTempTh - MODBUS_REGISTERS::iregDisplayMode + 1);
-    modbus.addHreg(MODBUS_REGISTERS::hregTempTarget, 0, 1);
-    modbus.addHreg(MODBUS_REGISTERS::hregPressKey, 0, 1);
-    modbus.addCoil(MODBUS_REGISTERS::cregRefreshStatus, false, 1);
-    modbus.addCoil(MODBUS_REGISTERS::cregPowerOn, false, 1);
-    modbus.onSetHreg(MODBUS_REGISTERS::hregPressKey, onSetPressKeyCallback, 1);
-    modbus.onSetHreg(MODBUS_REGISTERS::hregTempTarget, onSetTempTargetCallback, 1);
-    modbus.onGetHreg(MODBUS_REGISTERS::hregTempTarget, onGetTempTargetCallback, 1);
-    modbus.onGetIreg(MODBUS_REGISTERS::iregStatusAge, onGetStatusAgeCallback, 1);
-    modbus.onGetIreg(MODBUS_REGISTERS::iregStatusFlags, onGetStatusFlagsCallback, 1);
-    modbus.onSetCoil(MODBUS_REGISTERS::cregRefreshStatus, onSetRefreshStatusCallback, 1);
-    modbus.onSetCoil(MODBUS_REGISTERS::cregPowerOn, onSetPowerOnCallback, 1);
+    registerModbusMap(modbus);
+    modbus.onBeforeServe(applyTcpRegisterValues);
+    applyTcpRegisterValues();
+
+#if MODBUS_RTU_ENABLED
+    Serial2.begin(MODBUS_RTU_BAUD, SERIAL_8N1, PIN_MODBUS_RTU_RX, PIN_MODBUS_RTU_TX);
+    modbusRtu.begin(&Serial2, PIN_MODBUS_RTU_DE);
+    modbusRtu.slave(MODBUS_RTU_UNIT_ID);
+    registerModbusMap(modbusRtu);
+    applyRegisterValues(modbusRtu);
+#endif
+}
+
+#if MODBUS_RTU_ENABLED
+void modbusRtuTask(void* pvParameters) {
+    while (true) {
+        if (Serial2.available()) {
+            // request is being received, values are applied before it is complete
+            applyRegisterValues(modbusRtu);
+        }
+        modbusRtu.task();
+        vTaskDelay(1);
+    }
 }
+#endif
@@ -0,0 +1,61 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <lwip/sockets.h>
+#include "modbusServer.h"
+
+bool ModbusIPServer::hasPendingRequest() {
+    for (int i = 0; i < MODBUSIP_MAX_CLIENTS; i++) {
+        if (tcpclient[i] && tcpclient[i]->connected() && tcpclient[i]->available()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ModbusIPServer::waitForRequest(uint32_t timeoutMs) {
+    fd_set readSet;
+    FD_ZERO(&readSet);
+    int maxFd = -1;
+    for (int i = 0; i < MODBUSIP_MAX_CLIENTS; i++) {
+        if (!tcpclient[i] || !tcpclient[i]->connected()) {
+            continue;
+        }
+        if (tcpclient[i]->available()) {
+            // data already buffered by client
+            return true;
+        }
+        int fd = tcpclient[i]->fd();
+        if (fd >= 0) {
+            FD_SET(fd, &readSet);
+            if (fd > maxFd) {
+                maxFd = fd;
+            }
+        }
+    }
+
+    if (maxFd < 0) {
+        // no client connected, wait for new connection
+        delay(timeoutMs);
+        return false;
+    }
+
+    struct timeval timeout = {
+        .tv_sec = (time_t)(timeoutMs / 1000),
+        .tv_usec = (suseconds_t)((timeoutMs % 1000) * 1000),
+    };
+    // readable also means closed connection, task() cleans it up
+    return select(maxFd + 1, &readSet, NULL, NULL, &timeout) > 0;
+}
+
+void ModbusIPServer::serve() {
+    for (int round = 0; round < MODBUS_SERVE_MAX_ROUNDS; round++) {
+        if (beforeServeCallback) {
+            beforeServeCallback();
+        }
+        // one round serves all clients, MODBUSIP_MAX_READMS limits time spent on each of them
+        task();
+        if (!hasPendingRequest()) {
+            return;
+        }
+    }
+}
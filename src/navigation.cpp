@@ -0,0 +1,83 @@
+#include <Arduino.h>
+#include "navigation.h"
+
+/**
+ * Known transitions of panel UI. Vacation key is not here, setVacation is shown only if power is on.
+ */
+const NavigationEdge navigationEdges[] = {
+    // display is turned on by any key, it is locked then
+    { MODE::displayOff, KEYS::keyCancel, PRESS_ACTION::paTap, MODE::locked },
+    { MODE::locked, KEYS::keyEnter, PRESS_ACTION::paUnlock, MODE::unlocked },
+    // the first arrow press already changes shown value by one, cancel leaves target temperature unchanged
+    { MODE::unlocked, KEYS::keyUpArrow, PRESS_ACTION::paTap, MODE::setTemp },
+    { MODE::unlocked, KEYS::keyDownArrow, PRESS_ACTION::paTap, MODE::setTemp },
+    { MODE::setTemp, KEYS::keyCancel, PRESS_ACTION::paTap, MODE::unlocked },
+    { MODE::setVacation, KEYS::keyCancel, PRESS_ACTION::paTap, MODE::unlocked },
+    // decodeFrame reports the vacation screen as setVacation, the edge keeps MODE::vacation reachable if it is told apart
+    { MODE::vacation, KEYS::keyCancel, PRESS_ACTION::paTap, MODE::unlocked },
+    { MODE::setClock, KEYS::keyCancel, PRESS_ACTION::paTap, MODE::unlocked },
+    { MODE::unlocked, KEYS::keyEHeaterPlusDisinfect, PRESS_ACTION::paInfoToggle, MODE::infoT5U },
+    { MODE::infoT5U, KEYS::keyDownArrow, PRESS_ACTION::paTap, MODE::infoT5L },
+    { MODE::infoT5L, KEYS::keyDownArrow, PRESS_ACTION::paTap, MODE::infoT3 },
+    { MODE::infoT3, KEYS::keyDownArrow, PRESS_ACTION::paTap, MODE::infoT4 },
+    { MODE::infoT4, KEYS::keyDownArrow, PRESS_ACTION::paTap, MODE::infoTP },
+    { MODE::infoTP, KEYS::keyDownArrow, PRESS_ACTION::paTap, MODE::infoTh },
+    // info screens are left by the same key which enters them
+    { MODE::infoT5U, KEYS::keyEHeaterPlusDisinfect, PRESS_ACTION::paInfoToggle, MODE::unlocked },
+    { MODE::infoT5L, KEYS::keyEHeaterPlusDisinfect, PRESS_ACTION::paInfoToggle, MODE::unlocked },
+    { MODE::infoT3, KEYS::keyEHeaterPlusDisinfect, PRESS_ACTION::paInfoToggle, MODE::unlocked },
+    { MODE::infoT4, KEYS::keyEHeaterPlusDisinfect, PRESS_ACTION::paInfoToggle, MODE::unlocked },
+    { MODE::infoTP, KEYS::keyEHeaterPlusDisinfect, PRESS_ACTION::paInfoToggle, MODE::unlocked },
+    { MODE::infoTh, KEYS::keyEHeaterPlusDisinfect, PRESS_ACTION::paInfoToggle, MODE::unlocked },
+    { MODE::infoCE, KEYS::keyEHeaterPlusDisinfect, PRESS_ACTION::paInfoToggle, MODE::unlocked },
+    { MODE::infoER1, KEYS::keyEHeaterPlusDisinfect, PRESS_ACTION::paInfoToggle, MODE::unlocked },
+    { MODE::infoER2, KEYS::keyEHeaterPlusDisinfect, PRESS_ACTION::paInfoToggle, MODE::unlocked },
+    { MODE::infoER3, KEYS::keyEHeaterPlusDisinfect, PRESS_ACTION::paInfoToggle, MODE::unlocked },
+    { MODE::infoD7F, KEYS::keyEHeaterPlusDisinfect, PRESS_ACTION::paInfoToggle, MODE::unlocked },
+};
+
+const uint8_t navigationEdgeCount = sizeof(navigationEdges) / sizeof(navigationEdges[0]);
+
+const NavigationEdge* planNextEdge(MODE from, MODE to, const uint32_t* actionCosts) {
+    if (from == to) {
+        return nullptr;
+    }
+    // Dijkstra over the small graph, firstEdge is the first edge of the cheapest path to each mode
+    uint32_t cost[MODE_COUNT];
+    const NavigationEdge* firstEdge[MODE_COUNT];
+    bool done[MODE_COUNT];
+    for (int i = 0; i < MODE_COUNT; i++) {
+        cost[i] = UINT32_MAX;
+        firstEdge[i] = nullptr;
+        done[i] = false;
+    }
+    cost[from] = 0;
+
+    while (true) {
+        int current = -1;
+        for (int i = 0; i < MODE_COUNT; i++) {
+            if (!done[i] && cost[i] != UINT32_MAX && (current < 0 || cost[i] < cost[current])) {
+                current = i;
+            }
+        }
+        if (current < 0) {
+            return nullptr;
+        }
+        if (current == to) {
+            return firstEdge[to];
+        }
+        done[current] = true;
+
+        for (int i = 0; i < navigationEdgeCount; i++) {
+            const NavigationEdge& edge = navigationEdges[i];
+            if (edge.from != current) {
+                continue;
+            }
+            uint32_t edgeCost = cost[current] + actionCosts[edge.action];
+            if (edgeCost < cost[edge.to]) {
+                cost[edge.to] = edgeCost;
+                firstEdge[edge.to] = (current == from) ? &edge : firstEdge[current];
+            }
+        }
+    }
+}
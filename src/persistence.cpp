@@ -0,0 +1,372 @@
+#include <Arduino.h>
+#include <Preferences.h>
+#include "common.h"
+#include "heatPumpUnit.h"
+
+// min time between two writes of status to flash
+#define PERSIST_MIN_INTERVAL_MS (10 * 60 * 1000UL)
+// status with unchanged values is saved again to keep ages accurate, but not more often than this
+#define PERSIST_AGES_INTERVAL_MS (6 * 60 * 60 * 1000UL)
+
+#define PERSISTED_STATUS_VERSION 1
+#define PERSISTED_PRESS_DURATIONS_VERSION 1
+#define PERSISTED_TUNING_VERSION 3
+#define PERSISTED_SCHEDULE_VERSION 1
+
+/**
+ * Status stored in NVS. Ages are in seconds at the time of saving, UINT16_MAX means never updated.
+ */
+struct PersistedStatus {
+    uint8_t version;
+    uint8_t powerOn;
+    int8_t tempTarget;
+    int8_t temps[TEMP_SENSOR_COUNT];
+    uint16_t statusAge;
+    uint16_t tempTargetAge;
+    uint16_t tempAges[TEMP_SENSOR_COUNT];
+};
+
+/**
+ * Calibrated key press durations in ms, indexed by PRESS_ACTION.
+ */
+struct PersistedPressDurations {
+    uint8_t version;
+    uint16_t durations[PRESS_ACTION_COUNT];
+};
+
+/**
+ * Weekly schedule of one unit.
+ */
+struct PersistedSchedule {
+    uint8_t version;
+    ScheduleEntry entries[SCHEDULE_MAX_ENTRIES];
+};
+
+/**
+ * Timing parameters, indexed by TUNING_PARAM.
+ */
+struct PersistedTuning {
+    uint8_t version;
+    uint16_t values[TUNING_PARAM_COUNT];
+};
+
+/**
+ * Last saved status of one unit.
+ */
+struct PersistState {
+    PersistedStatus lastPersisted;
+    // refresh times of status when lastPersisted was saved or restored
+    uint32_t lastRefreshTime = 0;
+    uint32_t tempTargetUpdated = 0;
+    // lastPersisted is valid
+    bool persistedOnce = false;
+    // status was written since start, writes are rate limited from then
+    bool written = false;
+    uint32_t lastPersistMillis = 0;
+};
+
+PersistState persistStates[UNIT_COUNT];
+
+/**
+ * Returns NVS key of unit value. The first unit uses key of single unit firmware.
+ */
+const char* unitKey(const char* name, HeatPumpUnit& unit, char* buff) {
+    if (unit.getIndex() == 0) {
+        return name;
+    }
+    sprintf(buff, "%s%d", name, (int)unit.getIndex());
+    return buff;
+}
+
+uint32_t ageToTimestamp(uint16_t age, uint32_t nowMillis) {
+    if (age == UINT16_MAX) {
+        return 0;
+    }
+    uint32_t timestamp = nowMillis - age * 1000UL;
+    return timestamp ? timestamp : 1;
+}
+
+bool hasSameValues(const PersistedStatus& a, const PersistedStatus& b) {
+    return a.powerOn == b.powerOn && a.tempTarget == b.tempTarget && !memcmp(a.temps, b.temps, sizeof(a.temps));
+}
+
+/**
+ * Restores status saved before restart.
+ * @return true if status was restored and it contains values of a complete refresh
+ */
+bool restoreStatus(HeatPumpUnit& unit) {
+    Preferences prefs;
+    PersistedStatus persisted;
+    char keyBuff[8];
+    if (!prefs.begin("status", true)) {
+        return false;
+    }
+    bool valid = prefs.getBytes(unitKey("last", unit, keyBuff), &persisted, sizeof(persisted)) == sizeof(persisted)
+        && persisted.version == PERSISTED_STATUS_VERSION;
+    prefs.end();
+    if (!valid) {
+        Serial.printf("No persisted status of unit %d\n", (int)unit.getIndex());
+        return false;
+    }
+
+    uint32_t now = timeSource->millis();
+    StatusSnapshot status = {};
+    status.flags = persisted.powerOn ? STATUS_FLAGS::sfPowerOn : 0;
+    status.tempTarget = persisted.tempTarget;
+    status.tempTargetUpdated = ageToTimestamp(persisted.tempTargetAge, now);
+    status.lastRefreshTime = ageToTimestamp(persisted.statusAge, now);
+    for (int i = 0; i < TEMP_SENSOR_COUNT; i++) {
+        status.temps[i] = persisted.temps[i];
+        status.tempUpdated[i] = ageToTimestamp(persisted.tempAges[i], now);
+    }
+    unit.stateData.restore(status);
+    unit.stateData.publish();
+
+    PersistState& state = persistStates[unit.getIndex()];
+    state.lastPersisted = persisted;
+    state.lastRefreshTime = status.lastRefreshTime;
+    state.tempTargetUpdated = status.tempTargetUpdated;
+    state.persistedOnce = true;
+    Serial.printf("Status of unit %d restored, age: %d s\n", (int)unit.getIndex(), (int)persisted.statusAge);
+    return persisted.statusAge != UINT16_MAX;
+}
+
+/**
+ * Saves status to NVS when its values have changed. Writes are rate limited to protect flash, so all changes
+ * within PERSIST_MIN_INTERVAL_MS are written at once.
+ */
+void persistUnitStatus(HeatPumpUnit& unit, PersistState& state) {
+    uint32_t now = timeSource->millis();
+    if (state.written && now - state.lastPersistMillis < PERSIST_MIN_INTERVAL_MS) {
+        return;
+    }
+
+    StatusSnapshot status = unit.stateData.getSnapshot();
+    PersistedStatus persisted = {};
+    persisted.version = PERSISTED_STATUS_VERSION;
+    persisted.powerOn = (status.flags & STATUS_FLAGS::sfPowerOn) ? 1 : 0;
+    persisted.tempTarget = status.tempTarget;
+    persisted.statusAge = status.getStatusAgeSeconds(now);
+    persisted.tempTargetAge = ageSeconds(status.tempTargetUpdated, now);
+    for (int i = 0; i < TEMP_SENSOR_COUNT; i++) {
+        persisted.temps[i] = status.temps[i];
+        persisted.tempAges[i] = ageSeconds(status.tempUpdated[i], now);
+    }
+
+    if (persisted.statusAge == UINT16_MAX && persisted.tempTargetAge == UINT16_MAX) {
+        // nothing known yet
+        return;
+    }
+    bool refreshed = status.lastRefreshTime != state.lastRefreshTime
+        || status.tempTargetUpdated != state.tempTargetUpdated;
+    if (state.persistedOnce && hasSameValues(persisted, state.lastPersisted)
+        && (!refreshed || (state.written && now - state.lastPersistMillis < PERSIST_AGES_INTERVAL_MS))) {
+        // values are the same, ages are saved again only when they were refreshed since the last write
+        return;
+    }
+
+    Preferences prefs;
+    if (!prefs.begin("status", false)) {
+        Serial.printf("ERR: Failed to open NVS\n");
+        return;
+    }
+    char keyBuff[8];
+    if (prefs.putBytes(unitKey("last", unit, keyBuff), &persisted, sizeof(persisted)) == sizeof(persisted)) {
+        Serial.printf("Status of unit %d persisted\n", (int)unit.getIndex());
+    } else {
+        Serial.printf("ERR: Failed to persist status of unit %d\n", (int)unit.getIndex());
+    }
+    prefs.end();
+    state.lastPersisted = persisted;
+    state.lastRefreshTime = status.lastRefreshTime;
+    state.tempTargetUpdated = status.tempTargetUpdated;
+    state.persistedOnce = true;
+    state.written = true;
+    state.lastPersistMillis = now;
+}
+
+/**
+ * Restores calibrated key press durations, defaults are kept if there are none.
+ */
+void restorePressDurations(HeatPumpUnit& unit) {
+    Preferences prefs;
+    PersistedPressDurations persisted;
+    char keyBuff[8];
+    if (!prefs.begin("keys", true)) {
+        return;
+    }
+    bool valid = prefs.getBytes(unitKey("press", unit, keyBuff), &persisted, sizeof(persisted)) == sizeof(persisted)
+        && persisted.version == PERSISTED_PRESS_DURATIONS_VERSION;
+    prefs.end();
+    for (int i = 0; valid && i < PRESS_ACTION_COUNT; i++) {
+        valid = persisted.durations[i] >= pressCalibrations[i].minMs && persisted.durations[i] <= pressCalibrations[i].maxMs;
+    }
+    if (!valid) {
+        return;
+    }
+    unit.keyboardSequence.setPressDurations(persisted.durations);
+    Serial.printf("Key press durations of unit %d restored: %d, %d, %d ms\n", (int)unit.getIndex(),
+        persisted.durations[paTap], persisted.durations[paInfoToggle], persisted.durations[paUnlock]);
+}
+
+void persistPressDurations(HeatPumpUnit& unit) {
+    PersistedPressDurations persisted = {};
+    persisted.version = PERSISTED_PRESS_DURATIONS_VERSION;
+    for (int i = 0; i < PRESS_ACTION_COUNT; i++) {
+        persisted.durations[i] = unit.keyboardSequence.getPressDuration((PRESS_ACTION)i);
+    }
+
+    Preferences prefs;
+    char keyBuff[8];
+    if (!prefs.begin("keys", false)) {
+        Serial.printf("ERR: Failed to open NVS\n");
+        return;
+    }
+    if (prefs.putBytes(unitKey("press", unit, keyBuff), &persisted, sizeof(persisted)) != sizeof(persisted)) {
+        Serial.printf("ERR: Failed to persist key press durations of unit %d\n", (int)unit.getIndex());
+    }
+    prefs.end();
+}
+
+/**
+ * Restores timing parameters, defaults are kept for missing or invalid ones.
+ */
+void restoreTuning() {
+    Preferences prefs;
+    PersistedTuning persisted;
+    if (!prefs.begin("tuning", true)) {
+        return;
+    }
+    bool valid = prefs.getBytes("values", &persisted, sizeof(persisted)) == sizeof(persisted)
+        && persisted.version == PERSISTED_TUNING_VERSION;
+    prefs.end();
+    if (!valid) {
+        return;
+    }
+    for (int i = 0; i < TUNING_PARAM_COUNT; i++) {
+        tuning.set((TUNING_PARAM)i, persisted.values[i]);
+    }
+    // values are already saved
+    tuning.takeChanged();
+    Serial.printf("Tuning restored\n");
+}
+
+void persistTuning() {
+    PersistedTuning persisted = {};
+    persisted.version = PERSISTED_TUNING_VERSION;
+    for (int i = 0; i < TUNING_PARAM_COUNT; i++) {
+        persisted.values[i] = tuning.get((TUNING_PARAM)i);
+    }
+
+    Preferences prefs;
+    if (!prefs.begin("tuning", false)) {
+        Serial.printf("ERR: Failed to open NVS\n");
+        return;
+    }
+    if (prefs.putBytes("values", &persisted, sizeof(persisted)) != sizeof(persisted)) {
+        Serial.printf("ERR: Failed to persist tuning\n");
+    }
+    prefs.end();
+}
+
+void restoreSchedule(HeatPumpUnit& unit) {
+    Preferences prefs;
+    PersistedSchedule persisted;
+    char keyBuff[12];
+    if (!prefs.begin("schedule", true)) {
+        return;
+    }
+    bool valid = prefs.getBytes(unitKey("entries", unit, keyBuff), &persisted, sizeof(persisted)) == sizeof(persisted)
+        && persisted.version == PERSISTED_SCHEDULE_VERSION;
+    prefs.end();
+    if (!valid) {
+        return;
+    }
+    unit.schedule.setEntries(persisted.entries);
+    Serial.printf("Schedule of unit %d restored\n", (int)unit.getIndex());
+}
+
+void persistSchedule(HeatPumpUnit& unit) {
+    PersistedSchedule persisted = {};
+    persisted.version = PERSISTED_SCHEDULE_VERSION;
+    unit.schedule.getEntries(persisted.entries);
+
+    Preferences prefs;
+    char keyBuff[12];
+    if (!prefs.begin("schedule", false)) {
+        Serial.printf("ERR: Failed to open NVS\n");
+        return;
+    }
+    if (prefs.putBytes(unitKey("entries", unit, keyBuff), &persisted, sizeof(persisted)) != sizeof(persisted)) {
+        Serial.printf("ERR: Failed to persist schedule of unit %d\n", (int)unit.getIndex());
+    }
+    prefs.end();
+}
+
+time_t restoreScheduleCheckTime() {
+    Preferences prefs;
+    if (!prefs.begin("schedule", true)) {
+        return 0;
+    }
+    time_t time = prefs.getUInt("checked", 0);
+    prefs.end();
+    return time;
+}
+
+void persistScheduleCheckTime(time_t time) {
+    Preferences prefs;
+    if (!prefs.begin("schedule", false)) {
+        Serial.printf("ERR: Failed to open NVS\n");
+        return;
+    }
+    prefs.putUInt("checked", (uint32_t)time);
+    prefs.end();
+}
+
+/**
+ * Restores number of recovery restarts and restarts of each unit without a good frame.
+ */
+void restoreRecoveryRestarts() {
+    Preferences prefs;
+    char keyBuff[12];
+    if (!prefs.begin("recovery", true)) {
+        return;
+    }
+    recoveryRestarts = prefs.getUInt("restarts", 0);
+    for (auto& unit : units) {
+        unit.setRestartsWithoutFrame(prefs.getUChar(unitKey("noFrame", unit, keyBuff), 0));
+    }
+    prefs.end();
+}
+
+void persistRecoveryRestarts() {
+    Preferences prefs;
+    char keyBuff[12];
+    if (!prefs.begin("recovery", false)) {
+        Serial.printf("ERR: Failed to open NVS\n");
+        return;
+    }
+    prefs.putUInt("restarts", recoveryRestarts);
+    for (auto& unit : units) {
+        prefs.putUChar(unitKey("noFrame", unit, keyBuff), unit.getRestartsWithoutFrame());
+    }
+    prefs.end();
+}
+
+/**
+ * Saves changed status, calibrated key press durations, schedules and tuning. Called periodically by modbus task.
+ */
+void persistStatus() {
+    if (tuning.takeChanged()) {
+        persistTuning();
+    }
+    for (auto& unit : units) {
+        persistUnitStatus(unit, persistStates[unit.getIndex()]);
+        if (unit.keyboardSequence.takePressDurationsChanged()) {
+            persistPressDurations(unit);
+        }
+        if (unit.schedule.takeChanged()) {
+            persistSchedule(unit);
+        }
+    }
+}
@@ -0,0 +1,36 @@
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include "resourceMonitor.h"
+#include "timeSource.h"
+
+const char* monitoredTaskNames[MONITORED_TASK_COUNT] = { "loopTask", "displayTask", "modbusTask", "modbusRtuTask", "scheduleTask" };
+
+void ResourceMonitor::setStackFree(MONITORED_TASK task, uint32_t bytes) {
+    stackFree[task] = bytes;
+    if (bytes < STACK_LOW_WATER_BYTES && !lowStackReported[task]) {
+        lowStackReported[task] = true;
+        Serial.printf("ERR: %s has only %d bytes of stack left\n", monitoredTaskNames[task], (int)bytes);
+    }
+}
+
+void ResourceMonitor::sampleCurrentTask(MONITORED_TASK task) {
+    // high-water mark is in bytes on ESP32
+    setStackFree(task, uxTaskGetStackHighWaterMark(NULL));
+}
+
+void ResourceMonitor::sample() {
+    uint32_t now = timeSource->millis();
+    if (lastSampleMillis && now - lastSampleMillis < RESOURCE_SAMPLE_PERIOD_MS) {
+        return;
+    }
+    lastSampleMillis = now;
+
+    for (int i = 0; i < MONITORED_TASK_COUNT; i++) {
+        if (tasks[i]) {
+            setStackFree((MONITORED_TASK)i, uxTaskGetStackHighWaterMark(tasks[i]));
+        }
+    }
+    heapFree = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    heapLargestBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    heapMinFree = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+}
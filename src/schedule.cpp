@@ -0,0 +1,225 @@
+#include <Arduino.h>
+#include <time.h>
+#include "common.h"
+#include "heatPumpUnit.h"
+#include "schedule.h"
+
+// period of checking the schedule by schedule task
+#define SCHEDULE_CHECK_PERIOD_MS 10000
+// max number of attempts to apply action of due entry
+#define SCHEDULE_MAX_ATTEMPTS 5
+// time before this is not synchronised yet (2023-11-14)
+#define SCHEDULE_MIN_VALID_TIME 1700000000
+
+uint16_t Schedule::getField(uint8_t entry, SCHEDULE_FIELD field) {
+    portENTER_CRITICAL(&mux);
+    uint16_t value = entries[entry].fields[field];
+    portEXIT_CRITICAL(&mux);
+    return value;
+}
+
+bool Schedule::setField(uint8_t entry, SCHEDULE_FIELD field, uint16_t value) {
+    bool valid;
+    switch (field) {
+    case SCHEDULE_FIELD::sfDays:
+        valid = value <= 0x7F;
+        break;
+    case SCHEDULE_FIELD::sfMinute:
+        valid = value < MINUTES_PER_DAY;
+        break;
+    case SCHEDULE_FIELD::sfPower:
+        valid = value <= SCHEDULE_POWER_KEEP;
+        break;
+    case SCHEDULE_FIELD::sfTempTarget:
+        valid = value == SCHEDULE_TEMP_KEEP || (value >= 38 + 128 && value <= 60 + 128);
+        break;
+    default:
+        valid = false;
+    }
+    if (!valid) {
+        Serial.printf("ERR: invalid value %d of field %d of schedule entry %d\n", (int)value, field, (int)entry);
+        return false;
+    }
+    portENTER_CRITICAL(&mux);
+    bool differs = entries[entry].fields[field] != value;
+    entries[entry].fields[field] = value;
+    portEXIT_CRITICAL(&mux);
+    if (differs) {
+        changed = true;
+    }
+    return true;
+}
+
+void Schedule::getEntries(ScheduleEntry* copy) {
+    portENTER_CRITICAL(&mux);
+    memcpy(copy, entries, sizeof(entries));
+    portEXIT_CRITICAL(&mux);
+}
+
+void Schedule::setEntries(const ScheduleEntry* restored) {
+    portENTER_CRITICAL(&mux);
+    memcpy(entries, restored, sizeof(entries));
+    portEXIT_CRITICAL(&mux);
+}
+
+ScheduleAction Schedule::findDue(uint16_t minuteOfWeek, uint16_t windowMinutes) {
+    ScheduleEntry copy[SCHEDULE_MAX_ENTRIES];
+    getEntries(copy);
+
+    ScheduleAction action = { -1, SCHEDULE_TEMP_KEEP };
+    uint16_t powerAge = UINT16_MAX;
+    uint16_t tempAge = UINT16_MAX;
+    for (auto& entry : copy) {
+        for (int day = 0; day < 7; day++) {
+            if (!(entry.fields[sfDays] & (1 << day))) {
+                continue;
+            }
+            uint16_t entryMinute = day * MINUTES_PER_DAY + entry.fields[sfMinute];
+            // minutes since the last occurrence of the entry
+            uint16_t age = (minuteOfWeek + MINUTES_PER_WEEK - entryMinute) % MINUTES_PER_WEEK;
+            if (age >= windowMinutes) {
+                continue;
+            }
+            if (entry.fields[sfPower] != SCHEDULE_POWER_KEEP && age < powerAge) {
+                powerAge = age;
+                action.power = entry.fields[sfPower];
+            }
+            if (entry.fields[sfTempTarget] != SCHEDULE_TEMP_KEEP && age < tempAge) {
+                tempAge = age;
+                action.tempTarget = entry.fields[sfTempTarget];
+            }
+        }
+    }
+    return action;
+}
+
+/**
+ * Action of due entries waiting to be applied to one unit.
+ */
+struct PendingAction {
+    ScheduleAction action;
+    uint8_t attempts;
+};
+
+/**
+ * Applies pending action by key sequences, the same way as modbus writes of cregPowerOn and hregTempTarget do.
+ */
+void applyPendingAction(HeatPumpUnit& unit, PendingAction& pending) {
+    ScheduleAction& action = pending.action;
+    if (action.power < 0 && action.tempTarget == SCHEDULE_TEMP_KEEP) {
+        return;
+    }
+    if (pending.attempts++ >= SCHEDULE_MAX_ATTEMPTS) {
+        Serial.printf("ERR: schedule of unit %d not applied\n", (int)unit.getIndex());
+        action = { -1, SCHEDULE_TEMP_KEEP };
+        return;
+    }
+
+    if (action.power >= 0) {
+        Serial.printf("Schedule of unit %d: power %s\n", (int)unit.getIndex(), boolAsOnOffStr(action.power));
+        if (unit.keyboardSequence.processKeySequence(KEY_SEQUENCE::ksPowerOn, action.power, tuning.get(TUNING_PARAM::tpPowerOnTimeoutMs))
+            && ((bool)action.power) == (bool)(unit.stateData.getSnapshot().flags & STATUS_FLAGS::sfPowerOn))
+        {
+            action.power = -1;
+        }
+    }
+    if (action.tempTarget != SCHEDULE_TEMP_KEEP) {
+        int8_t targetTemp = action.tempTarget - 128;
+        Serial.printf("Schedule of unit %d: target temp %d\n", (int)unit.getIndex(), (int)targetTemp);
+        if (unit.keyboardSequence.processKeySequence(KEY_SEQUENCE::ksSetTargetTemp, targetTemp, tuning.get(TUNING_PARAM::tpSetTempTimeoutMs))
+            && unit.stateData.getSnapshot().tempTarget == targetTemp)
+        {
+            action.tempTarget = SCHEDULE_TEMP_KEEP;
+        }
+    }
+}
+
+uint16_t minuteOfWeekOf(time_t time) {
+    struct tm local;
+    localtime_r(&time, &local);
+    return local.tm_wday * MINUTES_PER_DAY + local.tm_hour * 60 + local.tm_min;
+}
+
+/**
+ * Returns window of entries missed since the last check which found due entries before restart. Without such check
+ * only entries of the current minute are due, so a restart doesn't undo later modbus writes.
+ */
+uint32_t missedWindowMinutes(time_t now, time_t lastDueCheck) {
+    if (lastDueCheck < SCHEDULE_MIN_VALID_TIME || lastDueCheck > now) {
+        return 1;
+    }
+    if (now - lastDueCheck >= MINUTES_PER_WEEK * 60) {
+        return MINUTES_PER_WEEK;
+    }
+    // the last checked minute was already applied
+    return (minuteOfWeekOf(now) + MINUTES_PER_WEEK - minuteOfWeekOf(lastDueCheck)) % MINUTES_PER_WEEK;
+}
+
+/**
+ * Runs schedules of all units by local time synchronised by NTP. Entries missed while the device was off are
+ * applied when time is synchronised after start: the most recent entry after the last check which found due entries
+ * wins. Time of that check is kept in NVS.
+ */
+void scheduleTask(void* pvParameters) {
+    PendingAction pending[UNIT_COUNT];
+    for (auto& unitPending : pending) {
+        unitPending = { { -1, SCHEDULE_TEMP_KEEP }, 0 };
+    }
+    // local minute of week at the last check, entries are due when local time passes them
+    uint16_t lastMinuteOfWeek = 0;
+    bool timeSynchronised = false;
+    time_t lastDueCheck = restoreScheduleCheckTime();
+
+    while (true) {
+        vTaskDelay(pdMS_TO_TICKS(SCHEDULE_CHECK_PERIOD_MS));
+        time_t now = time(nullptr);
+        if (now < SCHEDULE_MIN_VALID_TIME) {
+            continue;
+        }
+        uint16_t minuteOfWeek = minuteOfWeekOf(now);
+
+        // window is measured in local time, so entries in the hour skipped by DST change are run when it is skipped
+        // and entries in the repeated hour are not run twice
+        uint32_t windowMinutes;
+        if (!timeSynchronised) {
+            Serial.printf("Time synchronised, applying missed schedule entries\n");
+            timeSynchronised = true;
+            windowMinutes = missedWindowMinutes(now, lastDueCheck);
+            lastMinuteOfWeek = minuteOfWeek;
+        } else {
+            windowMinutes = (minuteOfWeek + MINUTES_PER_WEEK - lastMinuteOfWeek) % MINUTES_PER_WEEK;
+            if (windowMinutes > MINUTES_PER_WEEK / 2) {
+                // local time went back, wait until it passes the last checked minute again
+                windowMinutes = 0;
+            } else {
+                lastMinuteOfWeek = minuteOfWeek;
+            }
+        }
+
+        bool anyDue = false;
+        for (auto& unit : units) {
+            PendingAction& unitPending = pending[unit.getIndex()];
+            // entries are checked once per minute, failed actions are retried at every check
+            ScheduleAction due = { -1, SCHEDULE_TEMP_KEEP };
+            if (windowMinutes) {
+                due = unit.schedule.findDue(minuteOfWeek, windowMinutes);
+            }
+            if (due.power >= 0 || due.tempTarget != SCHEDULE_TEMP_KEEP) {
+                if (due.power >= 0) {
+                    unitPending.action.power = due.power;
+                }
+                if (due.tempTarget != SCHEDULE_TEMP_KEEP) {
+                    unitPending.action.tempTarget = due.tempTarget;
+                }
+                unitPending.attempts = 0;
+                anyDue = true;
+            }
+            applyPendingAction(unit, unitPending);
+        }
+        if (anyDue) {
+            // written only when entries are due, checks without them don't wear flash
+            lastDueCheck = now;
+            persistScheduleCheckTime(now);
+        }
+    }
+}
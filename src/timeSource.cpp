@@ -0,0 +1,13 @@
+#include <Arduino.h>
+#include "timeSource.h"
+
+uint64_t SystemTimeSource::micros() {
+    return esp_timer_get_time();
+}
+
+void SystemTimeSource::delay(uint32_t ms) {
+    vTaskDelay(pdMS_TO_TICKS(ms));
+}
+
+SystemTimeSource systemTimeSource;
+TimeSource* timeSource = &systemTimeSource;
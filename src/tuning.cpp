@@ -0,0 +1,36 @@
+#include <Arduino.h>
+#include "common.h"
+#include "tuning.h"
+
+const TuningParam tuningParams[TUNING_PARAM_COUNT] = {
+    { "displayPeriodMs", DISPLAY_TASK_PERIOD_MS, 10, 100 },
+    { "spiTimeoutMs", 5000, 500, 60000 },
+    { "modbusIdleMs", MODBUS_TASK_IDLE_MS, 1, 1000 },
+    { "settleReads", 3, 1, 20 },
+    { "refreshTimeoutMs", 10000, 1000, 60000 },
+    { "powerOnTimeoutMs", 7000, 1000, 60000 },
+    { "setTempTimeoutMs", 13000, 1000, 60000 },
+    { "pressKeyMarginMs", 1000, 0, 10000 },
+    { "staleReadS", 0, 0, 3600 },
+    { "autoTuneBus", 0, 0, 1 },
+};
+
+Tuning::Tuning() {
+    for (int i = 0; i < TUNING_PARAM_COUNT; i++) {
+        values[i] = tuningParams[i].defaultValue;
+    }
+}
+
+bool Tuning::set(TUNING_PARAM param, uint16_t value) {
+    const TuningParam& def = tuningParams[param];
+    if (value < def.minValue || value > def.maxValue) {
+        Serial.printf("ERR: %s %d is out of range <%d;%d>\n", def.name, (int)value, (int)def.minValue, (int)def.maxValue);
+        return false;
+    }
+    if (values[param] != value) {
+        Serial.printf("set %s: %d\n", def.name, (int)value);
+        values[param] = value;
+        changed = true;
+    }
+    return true;
+}
@@ -0,0 +1,168 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <ESPmDNS.h>
+#include <Preferences.h>
+
+#include "common.h"
+
+#define WIFI_SSID "XXXX"
+#define WIFI_PASSWORD "YYYY"
+
+// Optional static IP skips DHCP, e.g. build flags:
+// -DWIFI_STATIC_IP=192,168,1,50 -DWIFI_GATEWAY=192,168,1,1 -DWIFI_SUBNET=255,255,255,0
+
+// first reconnect is immediate, following ones are delayed exponentially from min to max
+#define WIFI_RECONNECT_MIN_DELAY_MS 1000
+#define WIFI_RECONNECT_MAX_DELAY_MS 30000
+// attempts to associate with cached access point before falling back to full scan
+#define WIFI_FAST_CONNECT_ATTEMPTS 2
+// restarts connecting when no connected/disconnected event arrives
+#define WIFI_CONNECT_TIMEOUT_MS 15000
+
+/**
+ * Last access point the device was connected to, used to skip the channel scan.
+ */
+struct AccessPointCache {
+    uint8_t bssid[6];
+    uint8_t channel;
+};
+
+AccessPointCache apCache;
+bool apCacheValid = false;
+
+// set by WiFi event task, processed by modbus task
+volatile bool wifiGotIpEvent = false;
+volatile bool wifiDisconnectedEvent = false;
+// disconnect after connect timeout, its event is ignored because reconnect is already scheduled
+volatile bool wifiDisconnectRequested = false;
+AccessPointCache connectedAp;
+
+bool wifiConnecting = false;
+bool mdnsStarted = false;
+uint8_t wifiConnectAttempts = 0;
+uint32_t wifiConnectStartedMillis = 0;
+uint32_t wifiNextAttemptMillis = 0;
+
+void onWiFiEvent(WiFiEvent_t event, WiFiEventInfo_t info) {
+    switch (event) {
+    case ARDUINO_EVENT_WIFI_STA_CONNECTED:
+        memcpy(connectedAp.bssid, info.wifi_sta_connected.bssid, sizeof(connectedAp.bssid));
+        connectedAp.channel = info.wifi_sta_connected.channel;
+        wifiDisconnectRequested = false;
+        break;
+    case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+        wifiGotIpEvent = true;
+        break;
+    case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+        if (wifiDisconnectRequested && info.wifi_sta_disconnected.reason == WIFI_REASON_ASSOC_LEAVE) {
+            wifiDisconnectRequested = false;
+            break;
+        }
+        wifiDisconnectedEvent = true;
+        break;
+    default:
+        break;
+    }
+}
+
+void loadAccessPointCache() {
+    Preferences prefs;
+    if (prefs.begin("wifi", true)) {
+        apCacheValid = prefs.getBytes("ap", &apCache, sizeof(apCache)) == sizeof(apCache);
+        prefs.end();
+    }
+}
+
+void storeAccessPointCache() {
+    if (apCacheValid && !memcmp(&apCache, &connectedAp, sizeof(apCache))) {
+        // no change, save flash
+        return;
+    }
+    apCache = connectedAp;
+    apCacheValid = true;
+    Preferences prefs;
+    if (prefs.begin("wifi", false)) {
+        prefs.putBytes("ap", &apCache, sizeof(apCache));
+        prefs.end();
+    }
+}
+
+void connectWiFi() {
+    bool useCache = apCacheValid && wifiConnectAttempts < WIFI_FAST_CONNECT_ATTEMPTS;
+    Serial.printf("Connecting WiFi, attempt: %d, cached AP: %s\n", wifiConnectAttempts + 1, boolAsOnOffStr(useCache));
+    if (useCache) {
+        WiFi.begin(WIFI_SSID, WIFI_PASSWORD, apCache.channel, apCache.bssid);
+    } else {
+        WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+    }
+    wifiConnectAttempts++;
+    wifiConnecting = true;
+    wifiConnectStartedMillis = timeSource->millis();
+}
+
+void scheduleWiFiReconnect() {
+    wifiConnecting = false;
+    uint32_t delayMs = 0;
+    if (wifiConnectAttempts) {
+        uint8_t shift = (wifiConnectAttempts > 6) ? 6 : wifiConnectAttempts - 1;
+        delayMs = min((uint32_t)WIFI_RECONNECT_MIN_DELAY_MS << shift, (uint32_t)WIFI_RECONNECT_MAX_DELAY_MS);
+    }
+    wifiNextAttemptMillis = timeSource->millis() + delayMs;
+}
+
+/**
+ * Starts connecting to WiFi and returns immediately, connection is maintained by verifyWiFiConnected().
+ */
+void initializeWiFi() {
+    loadAccessPointCache();
+    WiFi.persistent(false);
+    WiFi.setAutoReconnect(false);
+    WiFi.mode(WIFI_STA);
+    WiFi.setSleep(false);
+    WiFi.onEvent(onWiFiEvent);
+#ifdef WIFI_STATIC_IP
+    WiFi.config(IPAddress(WIFI_STATIC_IP), IPAddress(WIFI_GATEWAY), IPAddress(WIFI_SUBNET), IPAddress(WIFI_GATEWAY));
+#endif
+    connectWiFi();
+    // SNTP synchronises time in background whenever WiFi is connected
+    configTzTime(SCHEDULE_TZ, NTP_SERVER);
+}
+
+/**
+ * Handles WiFi events, called periodically by modbus task.
+ */
+void verifyWiFiConnected() {
+    if (wifiGotIpEvent) {
+        wifiGotIpEvent = false;
+        wifiConnecting = false;
+        wifiConnectAttempts = 0;
+        Serial.printf("WiFi connected, IP address: ");
+        Serial.println(WiFi.localIP());
+        storeAccessPointCache();
+        if (!mdnsStarted) {
+            mdnsStarted = MDNS.begin("boiler");
+            if (mdnsStarted) {
+                MDNS.addService("http", "tcp", 80);
+                MDNS.addService("modbus", "tcp", 502);
+                Serial.println("mDNS responder started");
+            } else {
+                Serial.println("Error setting up MDNS responder!");
+            }
+        }
+    }
+
+    if (wifiDisconnectedEvent) {
+        wifiDisconnectedEvent = false;
+        Serial.printf("WiFi disconnected\n");
+        scheduleWiFiReconnect();
+    } else if (wifiConnecting && timeSource->millis() - wifiConnectStartedMillis > WIFI_CONNECT_TIMEOUT_MS) {
+        Serial.printf("WiFi connect timeout\n");
+        wifiDisconnectRequested = true;
+        WiFi.disconnect();
+        scheduleWiFiReconnect();
+    }
+
+    if (!wifiConnecting && WiFi.status() != WL_CONNECTED && (int32_t)(timeSource->millis() - wifiNextAttemptMillis) >= 0) {
+        connectWiFi();
+    }
+}
@@ -0,0 +1,141 @@
+#ifndef B1F0C6D2_5A3E_4C7B_9E84_0D2A7F3C61E5
+#define B1F0C6D2_5A3E_4C7B_9E84_0D2A7F3C61E5
+
+/**
+ * Subset of Arduino core used by sources built for [env:native] tests. Serial prints to stdout, GPIO registers
+ * are plain memory and esp_timer runs on host steady clock.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+using std::max;
+using std::min;
+
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define NOP() ((void)0)
+
+enum gpio_num_t {
+    GPIO_NUM_0 = 0,
+    GPIO_NUM_1 = 1,
+    GPIO_NUM_2 = 2,
+    GPIO_NUM_3 = 3,
+    GPIO_NUM_4 = 4,
+    GPIO_NUM_5 = 5,
+    GPIO_NUM_6 = 6,
+    GPIO_NUM_7 = 7,
+    GPIO_NUM_8 = 8,
+    GPIO_NUM_9 = 9,
+    GPIO_NUM_10 = 10,
+    GPIO_NUM_11 = 11,
+    GPIO_NUM_12 = 12,
+    GPIO_NUM_13 = 13,
+    GPIO_NUM_14 = 14,
+    GPIO_NUM_15 = 15,
+    GPIO_NUM_16 = 16,
+    GPIO_NUM_17 = 17,
+    GPIO_NUM_18 = 18,
+    GPIO_NUM_19 = 19,
+    GPIO_NUM_20 = 20,
+    GPIO_NUM_21 = 21,
+    GPIO_NUM_22 = 22,
+    GPIO_NUM_23 = 23,
+    GPIO_NUM_24 = 24,
+    GPIO_NUM_25 = 25,
+    GPIO_NUM_26 = 26,
+    GPIO_NUM_27 = 27,
+    GPIO_NUM_28 = 28,
+    GPIO_NUM_29 = 29,
+    GPIO_NUM_30 = 30,
+    GPIO_NUM_31 = 31,
+    GPIO_NUM_32 = 32,
+    GPIO_NUM_33 = 33,
+    GPIO_NUM_34 = 34,
+    GPIO_NUM_35 = 35,
+    GPIO_NUM_36 = 36,
+    GPIO_NUM_37 = 37,
+    GPIO_NUM_38 = 38,
+    GPIO_NUM_39 = 39
+};
+
+struct GpioRegisters {
+    uint32_t out_w1ts;
+    uint32_t out_w1tc;
+    uint32_t enable_w1ts;
+    uint32_t enable_w1tc;
+    uint32_t in;
+    uint32_t enable;
+};
+
+inline GpioRegisters GPIO = {};
+
+inline void pinMode(uint8_t pin, uint8_t mode) {
+}
+
+inline void digitalWrite(uint8_t pin, uint8_t value) {
+}
+
+inline int64_t esp_timer_get_time() {
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+inline unsigned long micros() {
+    return (unsigned long)esp_timer_get_time();
+}
+
+inline unsigned long millis() {
+    return (unsigned long)(esp_timer_get_time() / 1000);
+}
+
+inline void delay(uint32_t ms) {
+    vTaskDelay(pdMS_TO_TICKS(ms));
+}
+
+inline void delayMicroseconds(uint32_t us) {
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+inline void yield() {
+}
+
+class HardwareSerial {
+public:
+    void begin(unsigned long baud) {
+    }
+    int printf(const char* format, ...) {
+        va_list args;
+        va_start(args, format);
+        int len = vprintf(format, args);
+        va_end(args);
+        return len;
+    }
+    size_t print(const char* str) {
+        return fputs(str, stdout) < 0 ? 0 : strlen(str);
+    }
+    size_t println(const char* str = "") {
+        return print(str) + print("\n");
+    }
+};
+
+inline HardwareSerial Serial;
+
+#endif /* B1F0C6D2_5A3E_4C7B_9E84_0D2A7F3C61E5 */
@@ -0,0 +1,12 @@
+#ifndef E3A7B20C_94D1_4E58_A6F2_8C0B5D1E7F94
+#define E3A7B20C_94D1_4E58_A6F2_8C0B5D1E7F94
+
+/**
+ * Declaration of modbus TCP server for headers shared with [env:native] tests, which do not serve modbus TCP.
+ */
+class Modbus;
+
+class ModbusIP {
+};
+
+#endif /* E3A7B20C_94D1_4E58_A6F2_8C0B5D1E7F94 */
@@ -0,0 +1,25 @@
+#ifndef C7E2A914_3B6D_4F0A_8C51_9D4E2B7A60F3
+#define C7E2A914_3B6D_4F0A_8C51_9D4E2B7A60F3
+
+/**
+ * FreeRTOS types and critical sections for [env:native] tests, which run in a single thread.
+ */
+
+#include <cstdint>
+
+typedef uint32_t TickType_t;
+typedef void* TaskHandle_t;
+
+typedef struct {
+    uint32_t owner;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED { 0 }
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux) ((void)(mux))
+#define portENTER_CRITICAL_ISR(mux) ((void)(mux))
+#define portEXIT_CRITICAL_ISR(mux) ((void)(mux))
+
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+#endif /* C7E2A914_3B6D_4F0A_8C51_9D4E2B7A60F3 */
@@ -0,0 +1,12 @@
+#ifndef A58D3F17_C2E4_4A96_B03E_71F6D9C2845B
+#define A58D3F17_C2E4_4A96_B03E_71F6D9C2845B
+
+#include <chrono>
+#include <thread>
+#include "FreeRTOS.h"
+
+inline void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+#endif /* A58D3F17_C2E4_4A96_B03E_71F6D9C2845B */
@@ -0,0 +1,266 @@
+#ifndef F8059F4E_9D63_491F_B639_0C8CF6706724
+#define F8059F4E_9D63_491F_B639_0C8CF6706724
+
+#include <initializer_list>
+#include <unity.h>
+#include "common.h"
+#include "commandTrace.h"
+#include "displayFrame.h"
+#include "keySequences.h"
+
+// the shortest holds accepted by simulated panel, default press durations are longer
+#define PANEL_UNLOCK_MS 3000
+#define PANEL_INFO_TOGGLE_MS 1000
+
+/**
+ * Max virtual time of sequences run by runSequences.
+ */
+#define SIMULATED_SEQUENCE_MAX_MS 60000
+
+const KeyboardPins testPins = {
+    { PIN_KEYBOARD_IN_ROW_1, PIN_KEYBOARD_IN_ROW_2, PIN_KEYBOARD_IN_ROW_3 },
+    { PIN_KEYBOARD_OUT_COL_1, PIN_KEYBOARD_OUT_COL_2, PIN_KEYBOARD_OUT_COL_3 },
+};
+
+// segments of digits 0 - 9 as decoded by segmentsToChar
+const uint8_t digitSegments[10] = { 0xFA, 0x60, 0xBC, 0xF4, 0x66, 0xD6, 0xDE, 0x70, 0xFE, 0xF6 };
+#define SEGMENTS_MINUS 0x04
+
+// label digits of info screens infoT5U - infoTh in frame bytes 10 - 12
+const uint8_t infoLabelBytes[TEMP_SENSOR_COUNT][3] = {
+    { 0xEA, 0xD6, 0x8E },
+    { 0x8A, 0xD6, 0x8E },
+    { 0xF4, 0x8E, 0x00 },
+    { 0x66, 0x8E, 0x00 },
+    { 0x3E, 0x8E, 0x00 },
+    { 0x4E, 0x8E, 0x00 },
+};
+
+/**
+ * Fills received buffer as SPI slave gets it: header byte and frame shifted by 1 bit.
+ */
+inline void toReceived(const uint8_t* frame, uint8_t* received) {
+    received[0] = 0b10100000;
+    for (int i = 0; i < DISPLAY_FRAME_SIZE; i++) {
+        received[i + 1] = (frame[i] >> 1) | ((i > 0 && (frame[i - 1] & 1)) ? 0x80 : 0);
+    }
+    received[DISPLAY_FRAME_SIZE + 1] = (frame[DISPLAY_FRAME_SIZE - 1] & 1) ? 0x80 : 0;
+}
+
+/**
+ * Panel of heatpump driven by key presses recorded in command trace. Holds shorter than the panel needs are ignored.
+ */
+struct SimulatedPanel {
+    const uint8_t unit;
+    MODE mode = MODE::displayOff;
+    bool powerOn = true;
+    bool hot = false;
+    bool pump = false;
+    int8_t tempTarget = 50;
+    int8_t shownSetTemp = 0;
+    int8_t temps[TEMP_SENSOR_COUNT] = { 45, 44, 20, 15, 60, 30 };
+    // panel doesn't react to keys, e.g. keyboard is disconnected
+    bool keysIgnored = false;
+    uint32_t traceIndex;
+
+    SimulatedPanel(uint8_t unit) : unit(unit), traceIndex(commandTrace.getEndIndex()) {
+    }
+
+    void press(KEYS key, uint16_t durationMs) {
+        if (keysIgnored) {
+            return;
+        }
+        switch (mode) {
+        case MODE::displayOff:
+            mode = MODE::locked;
+            break;
+        case MODE::locked:
+            if (key == KEYS::keyEnter && durationMs >= PANEL_UNLOCK_MS) {
+                mode = MODE::unlocked;
+            }
+            break;
+        case MODE::unlocked:
+            if (key == KEYS::keyUpArrow || key == KEYS::keyDownArrow) {
+                shownSetTemp = tempTarget + ((key == KEYS::keyUpArrow) ? 1 : -1);
+                mode = MODE::setTemp;
+            } else if (key == KEYS::keyVacation && powerOn) {
+                mode = MODE::setVacation;
+            } else if (key == KEYS::keyEHeaterPlusDisinfect && durationMs >= PANEL_INFO_TOGGLE_MS) {
+                mode = MODE::infoT5U;
+            }
+            break;
+        case MODE::setTemp:
+            if (key == KEYS::keyUpArrow) {
+                shownSetTemp++;
+            } else if (key == KEYS::keyDownArrow) {
+                shownSetTemp--;
+            } else if (key == KEYS::keyEnter) {
+                tempTarget = shownSetTemp;
+                mode = MODE::unlocked;
+            } else if (key == KEYS::keyCancel) {
+                mode = MODE::unlocked;
+            }
+            break;
+        case MODE::setVacation:
+            if (key == KEYS::keyCancel) {
+                mode = MODE::unlocked;
+            }
+            break;
+        default:
+            if (key == KEYS::keyDownArrow && mode < MODE::infoTh) {
+                mode = (MODE)(mode + 1);
+            } else if (key == KEYS::keyEHeaterPlusDisinfect && durationMs >= PANEL_INFO_TOGGLE_MS) {
+                mode = MODE::unlocked;
+            }
+        }
+    }
+
+    /**
+     * Applies key presses of the unit recorded since the last call.
+     */
+    void readKeys() {
+        TraceEvent event;
+        for (; traceIndex < commandTrace.getEndIndex(); traceIndex++) {
+            if (commandTrace.get(traceIndex, event) && event.unit == unit && event.type == TRACE_EVENT::teKeyDown) {
+                press((KEYS)event.arg, event.value);
+            }
+        }
+    }
+
+    /**
+     * Writes value -9 - 99 to value digits of frame.
+     */
+    static void encodeValue(uint8_t* data, int8_t value) {
+        uint8_t ones = digitSegments[abs(value) % 10];
+        uint8_t tens = (value < 0) ? SEGMENTS_MINUS : ((value >= 10) ? digitSegments[value / 10] : 0);
+        data[3] |= ones >> 4;
+        data[4] |= ((ones & 0x0E) << 4) | (tens >> 4);
+        data[5] |= (tens & 0x0E) << 4;
+    }
+
+    /**
+     * Writes frame of current screen as sent by panel.
+     */
+    void encodeFrame(uint8_t* data) {
+        memset(data, 0, DISPLAY_FRAME_SIZE);
+        switch (mode) {
+        case MODE::displayOff:
+            return;
+        case MODE::locked:
+        case MODE::unlocked:
+            encodeValue(data, temps[TEMP_SENSOR::tsT5U]);
+            data[15] |= (mode == MODE::locked) ? 1 << 0 : 0;
+            data[15] |= hot ? 1 << 4 : 0;
+            data[14] |= pump ? 1 << 6 : 0;
+            break;
+        case MODE::setTemp:
+            encodeValue(data, shownSetTemp);
+            data[6] |= 1 << 4;
+            break;
+        case MODE::setVacation:
+            encodeValue(data, tempTarget);
+            data[7] |= 1 << 4;
+            break;
+        default:
+            encodeValue(data, temps[mode - MODE::infoT5U]);
+            memcpy(data + 10, infoLabelBytes[mode - MODE::infoT5U], sizeof(infoLabelBytes[0]));
+        }
+    }
+};
+
+/**
+ * Unit without display bus, its display loop follows HeatPumpUnit::displayLoop. Frames of simulated panel are
+ * received, realigned and decoded as frames read from display bus.
+ */
+struct SimulatedUnit {
+    StateData stateData;
+    Keyboard keyboard;
+    KeyboardSequence sequence;
+    SimulatedPanel panel;
+
+    SimulatedUnit(uint8_t index)
+        : keyboard(index, stateData, testPins), sequence(index, keyboard, stateData), panel(index) {
+    }
+
+    void displayLoop() {
+        panel.readKeys();
+        stateData.onLoopStart();
+        stateData.publish();
+        keyboard.onLoop();
+        if (sequence.onLoop()) {
+            return;
+        }
+        sequence.startRequestedCalibration();
+        sequence.startRequestedRefresh();
+
+        uint8_t data[DISPLAY_FRAME_SIZE];
+        uint8_t received[DISPLAY_FRAME_SIZE + 2];
+        panel.encodeFrame(data);
+        toReceived(data, received);
+        realignFrame(received);
+        DisplayFrame frame;
+        decodeFrame(received, frame);
+        stateData.applyFrame(frame);
+        stateData.publish();
+        sequence.afterDisplayDataRead();
+    }
+};
+
+/**
+ * One period of display task serving all units.
+ */
+inline void displayTaskLoop(std::initializer_list<SimulatedUnit*> units) {
+    timeSource->delay(tuning.get(TUNING_PARAM::tpDisplayPeriodMs));
+    for (SimulatedUnit* unit : units) {
+        unit->displayLoop();
+    }
+}
+
+/**
+ * Runs display task until no unit runs a sequence.
+ * @return virtual millis taken by sequences
+ */
+inline uint32_t runSequences(std::initializer_list<SimulatedUnit*> units) {
+    uint32_t start = timeSource->millis();
+    while (true) {
+        bool running = false;
+        for (SimulatedUnit* unit : units) {
+            running |= unit->sequence.getCurrentSequence() != KEY_SEQUENCE::ksNone;
+        }
+        if (!running) {
+            return timeSource->millis() - start;
+        }
+        if (timeSource->millis() - start > SIMULATED_SEQUENCE_MAX_MS) {
+            TEST_FAIL_MESSAGE("sequences not finished in time");
+        }
+        displayTaskLoop(units);
+    }
+}
+
+/**
+ * Decodes current screen of unit, starts sequence and runs it to its end.
+ * @return virtual millis taken by sequence
+ */
+inline uint32_t runSequence(SimulatedUnit& unit, KEY_SEQUENCE sequence, uint16_t targetValue) {
+    displayTaskLoop({ &unit });
+    TEST_ASSERT_TRUE(unit.sequence.startKeySequence(sequence, targetValue));
+    return runSequences({ &unit });
+}
+
+/**
+ * Counts presses of key by unit since trace index, only holds of at least minMs are counted.
+ */
+inline int countKeyDowns(uint32_t fromIndex, uint8_t unit, KEYS key, uint16_t minMs = 0) {
+    int count = 0;
+    TraceEvent event;
+    for (uint32_t i = fromIndex; i < commandTrace.getEndIndex(); i++) {
+        if (commandTrace.get(i, event) && event.unit == unit && event.type == TRACE_EVENT::teKeyDown
+            && event.arg == key && event.value >= minMs)
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+#endif /* F8059F4E_9D63_491F_B639_0C8CF6706724 */
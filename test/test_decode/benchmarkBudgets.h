@@ -0,0 +1,13 @@
+#ifndef C3A1F7D2_5E84_4B0A_9F61_2D7B8E4C0A95
+#define C3A1F7D2_5E84_4B0A_9F61_2D7B8E4C0A95
+
+/**
+ * Max CPU cycles per call of the per-frame hot path on ESP32 at 240 MHz, code run from flash. The fastest of
+ * DECODE_BENCHMARK_RUNS measurements must fit. Budgets are about twice the count estimated from the -Os build,
+ * replace them by measured cycles printed by the suite plus 20 % once it has run on the device.
+ */
+#define BENCHMARK_BUDGET_REALIGN_CYCLES 400
+#define BENCHMARK_BUDGET_DECODE_INFO_CYCLES 900
+#define BENCHMARK_BUDGET_DECODE_UNLOCKED_CYCLES 1200
+
+#endif /* C3A1F7D2_5E84_4B0A_9F61_2D7B8E4C0A95 */
@@ -0,0 +1,207 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "common.h"
+#include "commandTrace.h"
+#include "../simulatedPanel.h"
+#include "benchmarkBudgets.h"
+
+#ifndef ARDUINO
+#include <chrono>
+#endif
+
+// iterations of one measurement, the fastest of DECODE_BENCHMARK_RUNS measurements is taken
+#define DECODE_BENCHMARK_ITERATIONS 1000
+#define DECODE_BENCHMARK_RUNS 5
+
+#ifndef ARDUINO
+// globals of main.cpp referenced by sources of native build
+CommandTrace commandTrace;
+Tuning tuning;
+#endif
+
+// info screen T5U showing 45
+const uint8_t infoFrame[DISPLAY_FRAME_SIZE] = { 0, 0, 0, 0x0D, 0x66, 0x60, 0, 0, 0, 0, 0xEA, 0xD6, 0x8E, 0, 0, 0 };
+// unlocked display with Hot and Pump icons showing 45
+const uint8_t unlockedFrame[DISPLAY_FRAME_SIZE] = { 0, 0, 0, 0x0D, 0x66, 0x60, 0, 0, 0, 0, 0, 0, 0, 0, 0x40, 0x10 };
+// info screen CE showing letters EE in value digits
+const uint8_t infoCEFrame[DISPLAY_FRAME_SIZE] = { 0, 0, 0, 0x09, 0xE9, 0xE0, 0, 0, 0, 0, 0x9E, 0x9A, 0, 0, 0, 0 };
+// info screen T5U showing letters EE in value digits
+const uint8_t infoT5UBadFrame[DISPLAY_FRAME_SIZE] = { 0, 0, 0, 0x09, 0xE9, 0xE0, 0, 0, 0, 0, 0xEA, 0xD6, 0x8E, 0, 0, 0 };
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_segmentsToChar() {
+    TEST_ASSERT_EQUAL_CHAR(' ', segmentsToChar(0));
+    TEST_ASSERT_EQUAL_CHAR('-', segmentsToChar(0b00000100));
+    TEST_ASSERT_EQUAL_CHAR('4', segmentsToChar(0b01100110));
+    TEST_ASSERT_EQUAL_CHAR('5', segmentsToChar(0b11010110));
+    // bit 0 is not part of digit
+    TEST_ASSERT_EQUAL_CHAR('8', segmentsToChar(0b11111111));
+    // letter E
+    TEST_ASSERT_EQUAL_CHAR(0, segmentsToChar(0b10011110));
+}
+
+void test_digitsToNumber() {
+    char digits[2] = { '4', '5' };
+    TEST_ASSERT_EQUAL_INT8(45, digitsToNumber(digits));
+    digits[0] = ' ';
+    TEST_ASSERT_EQUAL_INT8(5, digitsToNumber(digits));
+    digits[0] = '-';
+    digits[1] = '7';
+    TEST_ASSERT_EQUAL_INT8(-7, digitsToNumber(digits));
+    digits[0] = 0;
+    TEST_ASSERT_EQUAL_INT8(INVALID_TEMP, digitsToNumber(digits));
+    digits[0] = '1';
+    digits[1] = ' ';
+    TEST_ASSERT_EQUAL_INT8(INVALID_TEMP, digitsToNumber(digits));
+}
+
+void test_realignFrame() {
+    uint8_t received[DISPLAY_FRAME_SIZE + 2];
+    toReceived(infoFrame, received);
+    realignFrame(received);
+    TEST_ASSERT_EQUAL_MEMORY(infoFrame, received, DISPLAY_FRAME_SIZE);
+
+    toReceived(unlockedFrame, received);
+    realignFrame(received);
+    TEST_ASSERT_EQUAL_MEMORY(unlockedFrame, received, DISPLAY_FRAME_SIZE);
+}
+
+void test_decodeFrame_info() {
+    DisplayFrame frame;
+    decodeFrame(infoFrame, frame);
+    TEST_ASSERT_EQUAL(MODE::infoT5U, frame.mode);
+    TEST_ASSERT_EQUAL_INT8(45, frame.value);
+    TEST_ASSERT_EQUAL_UINT8(0, frame.bcdErrors);
+    TEST_ASSERT_EQUAL_UINT16(0, frame.icons);
+}
+
+void test_decodeFrame_unlocked() {
+    DisplayFrame frame;
+    decodeFrame(unlockedFrame, frame);
+    TEST_ASSERT_EQUAL(MODE::unlocked, frame.mode);
+    TEST_ASSERT_EQUAL_UINT16(DISPLAY_ICON::diHot | DISPLAY_ICON::diPump, frame.icons);
+    TEST_ASSERT_EQUAL_INT8(45, frame.value);
+    TEST_ASSERT_FALSE(frame.unknownLabel);
+}
+
+void test_decodeFrame_displayOff() {
+    uint8_t blank[DISPLAY_FRAME_SIZE] = {};
+    DisplayFrame frame;
+    decodeFrame(blank, frame);
+    TEST_ASSERT_EQUAL(MODE::displayOff, frame.mode);
+}
+
+void test_decodeFrame_bcdErrors() {
+    DisplayFrame frame;
+    // letters are expected on diagnostic info screens
+    decodeFrame(infoCEFrame, frame);
+    TEST_ASSERT_EQUAL(MODE::infoCE, frame.mode);
+    TEST_ASSERT_EQUAL_INT8(INVALID_TEMP, frame.value);
+    TEST_ASSERT_EQUAL_UINT8(0, frame.bcdErrors);
+
+    decodeFrame(infoT5UBadFrame, frame);
+    TEST_ASSERT_EQUAL(MODE::infoT5U, frame.mode);
+    TEST_ASSERT_EQUAL_UINT8(2, frame.bcdErrors);
+}
+
+#ifdef ARDUINO
+#define BENCHMARK_UNIT "cycles"
+
+uint32_t benchmarkTicks() {
+    return ESP.getCycleCount();
+}
+#else
+#define BENCHMARK_UNIT "ns"
+
+uint32_t benchmarkTicks() {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+/**
+ * Measures time per call. On the device it must fit cycle budget of benchmarkBudgets.h, on host wall clock time
+ * depends on machine and its load, so it is reported only.
+ */
+void benchmark(const char* name, void (*fn)(), uint32_t budgetCycles) {
+    uint32_t best = UINT32_MAX;
+    for (int run = 0; run < DECODE_BENCHMARK_RUNS; run++) {
+        uint32_t start = benchmarkTicks();
+        for (int i = 0; i < DECODE_BENCHMARK_ITERATIONS; i++) {
+            fn();
+        }
+        uint32_t ticks = (benchmarkTicks() - start) / DECODE_BENCHMARK_ITERATIONS;
+        best = min(best, ticks);
+    }
+
+#ifdef ARDUINO
+    Serial.printf("INFO: benchmark %s: %u " BENCHMARK_UNIT "/call, budget %u\n", name, (unsigned)best,
+        (unsigned)budgetCycles);
+    TEST_ASSERT_MESSAGE(best <= budgetCycles, "call takes more cycles than its budget");
+#else
+    Serial.printf("INFO: benchmark %s: %u " BENCHMARK_UNIT "/call\n", name, (unsigned)best);
+#endif
+}
+
+uint8_t benchReceived[DISPLAY_FRAME_SIZE + 2];
+DisplayFrame benchFrame;
+
+void benchRealign() {
+    realignFrame(benchReceived);
+}
+
+void benchDecodeInfo() {
+    decodeFrame(infoFrame, benchFrame);
+}
+
+void benchDecodeUnlocked() {
+    decodeFrame(unlockedFrame, benchFrame);
+}
+
+void test_benchmark_realignFrame() {
+    toReceived(infoFrame, benchReceived);
+    benchmark("realign", benchRealign, BENCHMARK_BUDGET_REALIGN_CYCLES);
+}
+
+void test_benchmark_decodeFrame_info() {
+    benchmark("decodeInfo", benchDecodeInfo, BENCHMARK_BUDGET_DECODE_INFO_CYCLES);
+}
+
+void test_benchmark_decodeFrame_unlocked() {
+    benchmark("decodeUnlocked", benchDecodeUnlocked, BENCHMARK_BUDGET_DECODE_UNLOCKED_CYCLES);
+}
+
+int runTests() {
+    UNITY_BEGIN();
+    RUN_TEST(test_segmentsToChar);
+    RUN_TEST(test_digitsToNumber);
+    RUN_TEST(test_realignFrame);
+    RUN_TEST(test_decodeFrame_info);
+    RUN_TEST(test_decodeFrame_unlocked);
+    RUN_TEST(test_decodeFrame_displayOff);
+    RUN_TEST(test_decodeFrame_bcdErrors);
+    RUN_TEST(test_benchmark_realignFrame);
+    RUN_TEST(test_benchmark_decodeFrame_info);
+    RUN_TEST(test_benchmark_decodeFrame_unlocked);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup() {
+    // wait for test runner to open serial port
+    delay(2000);
+    runTests();
+}
+
+void loop() {
+}
+#else
+int main(int argc, char** argv) {
+    return runTests();
+}
+#endif
@@ -0,0 +1,231 @@
+#include <Arduino.h>
+#include <ModbusRTU.h>
+#include <unity.h>
+#include "common.h"
+#include "heatPumpUnit.h"
+
+/**
+ * Max time of one request and response including silence which ends the frame.
+ */
+#define RTU_RESPONSE_TIMEOUT_MS 200
+#define RTU_SLAVE_ID 1
+#define RTU_FRAME_MAX 256
+
+/**
+ * Serial line of modbus server kept in memory. The test writes requests for the server and reads its responses.
+ */
+class LoopbackStream : public Stream {
+    uint8_t request[RTU_FRAME_MAX];
+    size_t requestLength = 0;
+    size_t requestRead = 0;
+
+public:
+    uint8_t response[RTU_FRAME_MAX];
+    size_t responseLength = 0;
+
+    void sendRequest(const uint8_t* data, size_t length) {
+        memcpy(request, data, length);
+        requestLength = length;
+        requestRead = 0;
+        responseLength = 0;
+    }
+
+    int available() override {
+        return requestLength - requestRead;
+    }
+
+    int read() override {
+        return (requestRead < requestLength) ? request[requestRead++] : -1;
+    }
+
+    int peek() override {
+        return (requestRead < requestLength) ? request[requestRead] : -1;
+    }
+
+    using Print::write;
+
+    size_t write(uint8_t c) override {
+        if (responseLength >= sizeof(response)) {
+            return 0;
+        }
+        response[responseLength++] = c;
+        return 1;
+    }
+
+    void flush() override {
+    }
+};
+
+ModbusRTU rtu;
+LoopbackStream serverPort;
+
+uint16_t crc16(const uint8_t* data, size_t length) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+        }
+    }
+    return crc;
+}
+
+/**
+ * Sends request of slave, function and two 16-bit words and serves it by the modbus task of the project.
+ * @return length of response with valid CRC, 0 if there is none
+ */
+size_t transact(uint8_t slaveId, uint8_t function, uint16_t first, uint16_t second, uint8_t* response, size_t size) {
+    uint8_t request[8] = { slaveId, function, (uint8_t)(first >> 8), (uint8_t)first, (uint8_t)(second >> 8), (uint8_t)second };
+    uint16_t crc = crc16(request, 6);
+    request[6] = crc & 0xFF;
+    request[7] = crc >> 8;
+    serverPort.sendRequest(request, sizeof(request));
+
+    // the same steps as modbusRtuTask: values are applied while request is received, then it is served
+    applyRegisterValues(rtu);
+    uint32_t start = millis();
+    while (!serverPort.responseLength && millis() - start < RTU_RESPONSE_TIMEOUT_MS) {
+        rtu.task();
+        delay(1);
+    }
+
+    size_t received = serverPort.responseLength;
+    if (received < 4 || received > size) {
+        return 0;
+    }
+    memcpy(response, serverPort.response, received);
+    // CRC is sent low byte first
+    if (crc16(response, received - 2) != (response[received - 2] | (response[received - 1] << 8))) {
+        return 0;
+    }
+    return received;
+}
+
+/**
+ * Reads one register by function 3 or 4.
+ * @return register value, -1 if there is no valid response
+ */
+int32_t readRegister(uint8_t function, uint16_t address) {
+    uint8_t response[16];
+    size_t length = transact(RTU_SLAVE_ID, function, address, 1, response, sizeof(response));
+    if (length != 7 || response[1] != function || response[2] != 2) {
+        return -1;
+    }
+    return (response[3] << 8) | response[4];
+}
+
+int8_t tempTargetOf(uint8_t unitIndex) {
+    return 45 + unitIndex;
+}
+
+int8_t tempThOf(uint8_t unitIndex) {
+    return 33 + 8 * unitIndex;
+}
+
+void setUp() {
+    // status of each unit differs, ages are 0 so reads don't request background refresh
+    uint32_t now = timeSource->millis();
+    for (auto& unit : units) {
+        StatusSnapshot status = {};
+        status.tempTarget = tempTargetOf(unit.getIndex());
+        status.tempTargetUpdated = now;
+        status.lastRefreshTime = now;
+        for (int i = 0; i < TEMP_SENSOR_COUNT; i++) {
+            status.temps[i] = INT8_MIN;
+            status.tempUpdated[i] = now;
+        }
+        status.temps[TEMP_SENSOR::tsTh] = tempThOf(unit.getIndex());
+        unit.stateData.restore(status);
+        unit.stateData.publish();
+        unit.keyboardSequence.setPressDuration(PRESS_ACTION::paTap, pressCalibrations[PRESS_ACTION::paTap].defaultMs);
+    }
+}
+
+void tearDown() {
+}
+
+void test_readHoldingRegisterOfEachUnit() {
+    for (uint8_t unit = 0; unit < UNIT_COUNT; unit++) {
+        TEST_ASSERT_EQUAL_INT32(tempTargetOf(unit) + 128,
+            readRegister(0x03, unitRegisterBase(unit) + MODBUS_REGISTERS::hregTempTarget));
+    }
+}
+
+void test_readInputRegisterOfEachUnit() {
+    for (uint8_t unit = 0; unit < UNIT_COUNT; unit++) {
+        TEST_ASSERT_EQUAL_INT32(tempThOf(unit) + 128,
+            readRegister(0x04, unitRegisterBase(unit) + MODBUS_REGISTERS::iregTempTh));
+    }
+}
+
+void test_writeRoutedToUnit() {
+    // press duration is set by callback of register map without key presses
+    uint8_t last = UNIT_COUNT - 1;
+    uint16_t address = unitRegisterBase(last) + MODBUS_REGISTERS::hregTunePressTapMs;
+    uint16_t defaultMs = pressCalibrations[PRESS_ACTION::paTap].defaultMs;
+    uint8_t response[16];
+    size_t length = transact(RTU_SLAVE_ID, 0x06, address, defaultMs + 50, response, sizeof(response));
+    // write single register echoes request
+    TEST_ASSERT_EQUAL(8, length);
+    TEST_ASSERT_EQUAL_HEX8(0x06, response[1]);
+    for (auto& unit : units) {
+        uint16_t expectedMs = (unit.getIndex() == last) ? defaultMs + 50 : defaultMs;
+        TEST_ASSERT_EQUAL_UINT16(expectedMs, unit.keyboardSequence.getPressDuration(PRESS_ACTION::paTap));
+    }
+    TEST_ASSERT_EQUAL_INT32(defaultMs + 50, readRegister(0x03, address));
+}
+
+void test_invalidWriteKeepsValue() {
+    uint16_t address = unitRegisterBase(0) + MODBUS_REGISTERS::hregTunePressTapMs;
+    uint16_t defaultMs = pressCalibrations[PRESS_ACTION::paTap].defaultMs;
+    uint8_t response[16];
+    transact(RTU_SLAVE_ID, 0x06, address, pressCalibrations[PRESS_ACTION::paTap].maxMs + 1, response, sizeof(response));
+    TEST_ASSERT_EQUAL_UINT16(defaultMs, units[0].keyboardSequence.getPressDuration(PRESS_ACTION::paTap));
+    TEST_ASSERT_EQUAL_INT32(defaultMs, readRegister(0x03, address));
+}
+
+void test_missingUnitRejected() {
+    uint8_t response[16];
+    size_t length = transact(RTU_SLAVE_ID, 0x03, unitRegisterBase(UNIT_COUNT) + MODBUS_REGISTERS::hregTempTarget, 1,
+        response, sizeof(response));
+    // exception response: function with bit 7 set and illegal data address
+    TEST_ASSERT_EQUAL(5, length);
+    TEST_ASSERT_EQUAL_HEX8(0x83, response[1]);
+    TEST_ASSERT_EQUAL_HEX8(0x02, response[2]);
+}
+
+void test_otherSlaveIgnored() {
+    uint8_t response[16];
+    TEST_ASSERT_EQUAL(0, transact(RTU_SLAVE_ID + 1, 0x03, MODBUS_REGISTERS::hregTempTarget, 1, response,
+        sizeof(response)));
+}
+
+/**
+ * Serves register map of the project as initializeModbus does for RTU, serial port is replaced by loopback.
+ */
+void initializeServer() {
+    rtu.begin(&serverPort);
+    rtu.slave(RTU_SLAVE_ID);
+    registerModbusMap(rtu);
+}
+
+int runTests() {
+    initializeServer();
+    UNITY_BEGIN();
+    RUN_TEST(test_readHoldingRegisterOfEachUnit);
+    RUN_TEST(test_readInputRegisterOfEachUnit);
+    RUN_TEST(test_writeRoutedToUnit);
+    RUN_TEST(test_invalidWriteKeepsValue);
+    RUN_TEST(test_missingUnitRejected);
+    RUN_TEST(test_otherSlaveIgnored);
+    return UNITY_END();
+}
+
+void setup() {
+    // wait for test runner to open serial port
+    delay(2000);
+    runTests();
+}
+
+void loop() {
+}
@@ -0,0 +1,200 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "common.h"
+#include "commandTrace.h"
+#include "keySequences.h"
+#include "../simulatedPanel.h"
+
+#ifndef ARDUINO
+// globals of main.cpp referenced by sources of native build
+CommandTrace commandTrace;
+Tuning tuning;
+#endif
+
+VirtualTimeSource virtualTime;
+TimeSource* savedTimeSource;
+
+void setUp() {
+    savedTimeSource = timeSource;
+    timeSource = &virtualTime;
+    virtualTime.setMillis(1000);
+}
+
+void tearDown() {
+    timeSource = savedTimeSource;
+}
+
+void test_millisSince() {
+    StateData state;
+    virtualTime.setMillis(5);
+    state.onLoopStart();
+    TEST_ASSERT_EQUAL_UINT32(3, state.millisSince(2));
+    TEST_ASSERT_EQUAL_UINT32(0, state.millisSince(5));
+}
+
+void test_millisSince_wrapAround() {
+    StateData state;
+    virtualTime.setMillis(5);
+    state.onLoopStart();
+    TEST_ASSERT_EQUAL_UINT32(10, state.millisSince(UINT32_MAX - 4));
+    TEST_ASSERT_EQUAL_UINT32(6, state.millisSince(UINT32_MAX));
+}
+
+void test_millis_wrapAround() {
+    StateData state;
+    virtualTime.setMillis(UINT32_MAX);
+    state.onLoopStart();
+    uint32_t before = state.getNow();
+    virtualTime.advanceMillis(20);
+    state.onLoopStart();
+    TEST_ASSERT_EQUAL_UINT32(19, state.getNow());
+    TEST_ASSERT_EQUAL_UINT32(20, state.millisSince(before));
+}
+
+void test_keyHold() {
+    StateData state;
+    Keyboard keyboard(0, state, testPins);
+    state.onLoopStart();
+    keyboard.keyDown(KEYS::keyEnter, 3200);
+
+    virtualTime.advanceMillis(3200);
+    state.onLoopStart();
+    keyboard.onLoop();
+    TEST_ASSERT_TRUE(keyboard.isKeyDown());
+
+    virtualTime.advanceMillis(1);
+    state.onLoopStart();
+    keyboard.onLoop();
+    TEST_ASSERT_FALSE(keyboard.isKeyDown());
+}
+
+void test_keyHold_wrapAround() {
+    StateData state;
+    Keyboard keyboard(0, state, testPins);
+    virtualTime.setMillis(UINT32_MAX - 1000);
+    state.onLoopStart();
+    keyboard.keyDown(KEYS::keyEnter, 3200);
+
+    virtualTime.advanceMillis(3200);
+    state.onLoopStart();
+    keyboard.onLoop();
+    TEST_ASSERT_TRUE(keyboard.isKeyDown());
+
+    virtualTime.advanceMillis(1);
+    state.onLoopStart();
+    keyboard.onLoop();
+    TEST_ASSERT_FALSE(keyboard.isKeyDown());
+}
+
+void test_processKeySequence_timeout() {
+    SimulatedUnit unit(0);
+    uint16_t timeoutMs = tuning.get(TUNING_PARAM::tpSetTempTimeoutMs);
+    int64_t realStartUs = esp_timer_get_time();
+    uint32_t start = timeSource->millis();
+
+    // no display loop takes the command
+    TEST_ASSERT_FALSE(unit.sequence.processKeySequence(KEY_SEQUENCE::ksSetTargetTemp, 47, timeoutMs));
+    TEST_ASSERT_GREATER_THAN_UINT32(timeoutMs, timeSource->millis() - start);
+    TEST_ASSERT_LESS_THAN_UINT32(1000, (uint32_t)((esp_timer_get_time() - realStartUs) / 1000));
+
+    // the next display loop releases abandoned command, so background refresh can start
+    unit.sequence.requestValueRefresh(TEMP_SENSOR::tsTh);
+    displayTaskLoop({ &unit });
+    TEST_ASSERT_EQUAL(KEY_SEQUENCE::ksRefreshValue, unit.sequence.getCurrentSequence());
+    TEST_ASSERT_EQUAL_INT(50, unit.panel.tempTarget);
+}
+
+void test_setTargetTemp_fromLocked() {
+    SimulatedUnit unit(0);
+    unit.panel.mode = MODE::locked;
+    uint32_t traceStart = commandTrace.getEndIndex();
+
+    uint32_t durationMs = runSequence(unit, KEY_SEQUENCE::ksSetTargetTemp, 47);
+    TEST_ASSERT_EQUAL_INT(47, unit.panel.tempTarget);
+    TEST_ASSERT_EQUAL_INT(47, unit.stateData.getTempTarget());
+    TEST_ASSERT_EQUAL(MODE::unlocked, unit.panel.mode);
+    TEST_ASSERT_EQUAL_INT(1, countKeyDowns(traceStart, 0, KEYS::keyEnter, PANEL_UNLOCK_MS));
+    TEST_ASSERT_LESS_THAN_UINT32(tuning.get(TUNING_PARAM::tpSetTempTimeoutMs), durationMs);
+}
+
+void test_setTargetTemp_fromSetTemp() {
+    SimulatedUnit unit(0);
+    unit.panel.mode = MODE::setTemp;
+    unit.panel.shownSetTemp = 50;
+    uint32_t traceStart = commandTrace.getEndIndex();
+
+    runSequence(unit, KEY_SEQUENCE::ksSetTargetTemp, 52);
+    TEST_ASSERT_EQUAL_INT(52, unit.panel.tempTarget);
+    TEST_ASSERT_EQUAL_INT(52, unit.stateData.getTempTarget());
+    // neither power probe nor unlock is needed
+    TEST_ASSERT_EQUAL_INT(0, countKeyDowns(traceStart, 0, KEYS::keyVacation));
+    TEST_ASSERT_EQUAL_INT(0, countKeyDowns(traceStart, 0, KEYS::keyEnter, PANEL_UNLOCK_MS));
+    TEST_ASSERT_EQUAL_INT(0, countKeyDowns(traceStart, 0, KEYS::keyCancel));
+}
+
+void test_refreshValue_fromDisplayOff() {
+    SimulatedUnit unit(0);
+    unit.panel.temps[TEMP_SENSOR::tsTh] = 33;
+
+    runSequence(unit, KEY_SEQUENCE::ksRefreshValue, TEMP_SENSOR::tsTh);
+    TEST_ASSERT_EQUAL_INT(33, unit.stateData.getTempTh());
+    TEST_ASSERT_EQUAL(MODE::unlocked, unit.panel.mode);
+}
+
+void test_refreshValue_failureHoldsOffRequests() {
+    SimulatedUnit unit(0);
+    unit.panel.keysIgnored = true;
+    uint16_t savedStaleReadS = tuning.get(TUNING_PARAM::tpStaleReadS);
+    tuning.set(TUNING_PARAM::tpStaleReadS, 60);
+
+    displayTaskLoop({ &unit });
+    unit.sequence.requestValueRefresh(TEMP_SENSOR::tsTh);
+    displayTaskLoop({ &unit });
+    TEST_ASSERT_EQUAL(KEY_SEQUENCE::ksRefreshValue, unit.sequence.getCurrentSequence());
+    runSequences({ &unit });
+
+    // the next stale read doesn't start another refresh until hold-off passes
+    uint32_t failedMillis = timeSource->millis();
+    unit.sequence.requestValueRefresh(TEMP_SENSOR::tsTh);
+    displayTaskLoop({ &unit });
+    TEST_ASSERT_EQUAL(KEY_SEQUENCE::ksNone, unit.sequence.getCurrentSequence());
+
+    virtualTime.setMillis(failedMillis + 60 * 1000UL);
+    unit.sequence.requestValueRefresh(TEMP_SENSOR::tsTh);
+    displayTaskLoop({ &unit });
+    TEST_ASSERT_EQUAL(KEY_SEQUENCE::ksRefreshValue, unit.sequence.getCurrentSequence());
+    tuning.set(TUNING_PARAM::tpStaleReadS, savedStaleReadS);
+}
+
+int runTests() {
+    UNITY_BEGIN();
+    RUN_TEST(test_millisSince);
+    RUN_TEST(test_millisSince_wrapAround);
+    RUN_TEST(test_millis_wrapAround);
+#ifndef ARDUINO
+    // these press keys, on device they would drive keyboard of connected unit
+    RUN_TEST(test_keyHold);
+    RUN_TEST(test_keyHold_wrapAround);
+    RUN_TEST(test_processKeySequence_timeout);
+    RUN_TEST(test_setTargetTemp_fromLocked);
+    RUN_TEST(test_setTargetTemp_fromSetTemp);
+    RUN_TEST(test_refreshValue_fromDisplayOff);
+    RUN_TEST(test_refreshValue_failureHoldsOffRequests);
+#endif
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup() {
+    // wait for test runner to open serial port
+    delay(2000);
+    runTests();
+}
+
+void loop() {
+}
+#else
+int main(int argc, char** argv) {
+    return runTests();
+}
+#endif
@@ -0,0 +1,127 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "common.h"
+#include "commandTrace.h"
+#include "dutyStats.h"
+#include "keySequences.h"
+#include "schedule.h"
+#include "../simulatedPanel.h"
+
+#ifndef ARDUINO
+// globals of main.cpp referenced by sources of native build
+CommandTrace commandTrace;
+Tuning tuning;
+#endif
+
+VirtualTimeSource virtualTime;
+TimeSource* savedTimeSource;
+
+void setUp() {
+    savedTimeSource = timeSource;
+    timeSource = &virtualTime;
+    virtualTime.setMillis(1000);
+}
+
+void tearDown() {
+    timeSource = savedTimeSource;
+}
+
+void test_registerRouting() {
+    TEST_ASSERT_EQUAL_UINT8(0, unitIndexOfRegister(MODBUS_REGISTERS::hregTempTarget));
+    TEST_ASSERT_EQUAL_UINT8(1, unitIndexOfRegister(UNIT_REGISTER_OFFSET + MODBUS_REGISTERS::hregTempTarget));
+    TEST_ASSERT_EQUAL_UINT16(MODBUS_REGISTERS::hregTempTarget,
+        registerWithinUnit(unitRegisterBase(1) + MODBUS_REGISTERS::hregTempTarget));
+    TEST_ASSERT_EQUAL_UINT16(UNIT_REGISTER_OFFSET, unitRegisterBase(1));
+}
+
+void test_registersFitUnitOffset() {
+    // the highest register of each array, registers of unit 0 must not reach into unit 1
+    const uint16_t lastRegisters[] = {
+        MODBUS_REGISTERS::hregScheduleDays + SCHEDULE_MAX_ENTRIES * SCHEDULE_ENTRY_REGISTERS - 1,
+        MODBUS_REGISTERS::iregStepRetries + SEQUENCE_MAX_STEPS - 1,
+        MODBUS_REGISTERS::iregStepAborts + SEQUENCE_MAX_STEPS - 1,
+        MODBUS_REGISTERS::iregDutyPumpOnSeconds + (DUTY_FLAG_COUNT - 1) * DUTY_REGISTER_STRIDE,
+        MODBUS_REGISTERS::hregTunePressUnlockMs,
+    };
+    for (uint16_t address : lastRegisters) {
+        TEST_ASSERT_LESS_THAN_UINT32(UNIT_REGISTER_OFFSET, address);
+        TEST_ASSERT_EQUAL_UINT8(0, unitIndexOfRegister(address));
+    }
+}
+
+void test_commandRoutedToOwnUnit() {
+    SimulatedUnit first(0);
+    SimulatedUnit second(1);
+    SimulatedUnit* units[] = { &first, &second };
+    first.panel.mode = MODE::unlocked;
+    second.panel.mode = MODE::unlocked;
+    uint32_t traceStart = commandTrace.getEndIndex();
+
+    // write of hregTempTarget of the second unit
+    uint16_t address = unitRegisterBase(1) + MODBUS_REGISTERS::hregTempTarget;
+    SimulatedUnit& unit = *units[unitIndexOfRegister(address)];
+    displayTaskLoop({ &first, &second });
+    TEST_ASSERT_TRUE(unit.sequence.startKeySequence(KEY_SEQUENCE::ksSetTargetTemp, 44));
+    runSequences({ &first, &second });
+
+    TEST_ASSERT_EQUAL_INT(44, second.panel.tempTarget);
+    TEST_ASSERT_EQUAL_INT(44, second.stateData.getSnapshot().tempTarget);
+    TEST_ASSERT_EQUAL_INT(50, first.panel.tempTarget);
+    TEST_ASSERT_EQUAL_INT(INT8_MIN, first.stateData.getSnapshot().tempTarget);
+    for (KEYS key : { KEYS::keyUpArrow, KEYS::keyDownArrow, KEYS::keyEnter, KEYS::keyCancel }) {
+        TEST_ASSERT_EQUAL_INT(0, countKeyDowns(traceStart, 0, key));
+    }
+}
+
+void test_statusKeptPerUnit() {
+    SimulatedUnit first(0);
+    SimulatedUnit second(1);
+    first.panel.temps[TEMP_SENSOR::tsTh] = 33;
+    first.panel.hot = true;
+    second.panel.mode = MODE::locked;
+    second.panel.temps[TEMP_SENSOR::tsTh] = 41;
+    second.panel.pump = true;
+
+    // both units refresh at the same time, frames of each panel go to its own unit only
+    displayTaskLoop({ &first, &second });
+    TEST_ASSERT_TRUE(first.sequence.startKeySequence(KEY_SEQUENCE::ksRefreshValue, TEMP_SENSOR::tsTh));
+    TEST_ASSERT_TRUE(second.sequence.startKeySequence(KEY_SEQUENCE::ksRefreshValue, TEMP_SENSOR::tsTh));
+    runSequences({ &first, &second });
+    displayTaskLoop({ &first, &second });
+
+    StatusSnapshot firstStatus = first.stateData.getSnapshot();
+    StatusSnapshot secondStatus = second.stateData.getSnapshot();
+    TEST_ASSERT_EQUAL_INT(33, firstStatus.temps[TEMP_SENSOR::tsTh]);
+    TEST_ASSERT_EQUAL_INT(41, secondStatus.temps[TEMP_SENSOR::tsTh]);
+    TEST_ASSERT_EQUAL_UINT16(STATUS_FLAGS::sfHot, firstStatus.flags & (STATUS_FLAGS::sfHot | STATUS_FLAGS::sfPump));
+    TEST_ASSERT_EQUAL_UINT16(STATUS_FLAGS::sfPump, secondStatus.flags & (STATUS_FLAGS::sfHot | STATUS_FLAGS::sfPump));
+    TEST_ASSERT_EQUAL(MODE::unlocked, firstStatus.mode);
+    TEST_ASSERT_EQUAL(MODE::unlocked, secondStatus.mode);
+}
+
+int runTests() {
+    UNITY_BEGIN();
+    RUN_TEST(test_registerRouting);
+    RUN_TEST(test_registersFitUnitOffset);
+#ifndef ARDUINO
+    // these press keys, on device they would drive keyboard of connected unit
+    RUN_TEST(test_commandRoutedToOwnUnit);
+    RUN_TEST(test_statusKeptPerUnit);
+#endif
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup() {
+    // wait for test runner to open serial port
+    delay(2000);
+    runTests();
+}
+
+void loop() {
+}
+#else
+int main(int argc, char** argv) {
+    return runTests();
+}
+#endif
@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+"""
+Modbus TCP load generator. Runs several concurrent pollers against the device (or any Modbus TCP server)
+and reports request rate and p50/p99 response time in total and per client.
+
+Example: tools/modbus_load.py boiler.local --clients 3 --duration 30
+"""
+import argparse
+import socket
+import struct
+import threading
+import time
+
+
+def percentile(sortedValues, p):
+    if not sortedValues:
+        return float('nan')
+    return sortedValues[min(len(sortedValues) - 1, int(len(sortedValues) * p / 100))]
+
+
+def recvExact(sock, length):
+    data = b''
+    while len(data) < length:
+        chunk = sock.recv(length - len(data))
+        if not chunk:
+            raise ConnectionError('connection closed')
+        data += chunk
+    return data
+
+
+def poller(args, clientId, deadline, results):
+    latencies = []
+    errors = 0
+    transactionId = 0
+    sock = socket.create_connection((args.host, args.port), timeout=args.timeout)
+    sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    try:
+        while time.monotonic() < deadline:
+            transactionId = (transactionId + 1) & 0xFFFF
+            # MBAP header + read input registers request
+            request = struct.pack('>HHHBBHH', transactionId, 0, 6, args.unit, 4, args.address, args.count)
+            start = time.perf_counter()
+            try:
+                sock.sendall(request)
+                header = recvExact(sock, 7)
+                respTransactionId, _, length, _ = struct.unpack('>HHHB', header)
+                body = recvExact(sock, length - 1)
+            except (socket.timeout, ConnectionError):
+                errors += 1
+                sock.close()
+                sock = socket.create_connection((args.host, args.port), timeout=args.timeout)
+                continue
+            latencies.append((time.perf_counter() - start) * 1000.0)
+            if respTransactionId != transactionId or body[0] & 0x80:
+                errors += 1
+            if args.interval:
+                time.sleep(args.interval / 1000.0)
+    finally:
+        sock.close()
+    results[clientId] = (latencies, errors)
+
+
+def report(name, latencies, errors, duration):
+    latencies = sorted(latencies)
+    print('%-8s requests: %6d  rate: %8.1f req/s  p50: %7.2f ms  p99: %7.2f ms  max: %7.2f ms  errors: %d' % (
+        name, len(latencies), len(latencies) / duration, percentile(latencies, 50), percentile(latencies, 99),
+        latencies[-1] if latencies else float('nan'), errors))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('host')
+    parser.add_argument('--port', type=int, default=502)
+    parser.add_argument('--unit', type=int, default=1)
+    parser.add_argument('--clients', type=int, default=3, help='number of concurrent connections')
+    parser.add_argument('--duration', type=float, default=10.0, help='test duration in seconds')
+    parser.add_argument('--interval', type=float, default=0.0, help='pause between requests of one client in ms')
+    parser.add_argument('--address', type=int, default=100, help='first input register to read')
+    parser.add_argument('--count', type=int, default=9, help='number of input registers to read')
+    parser.add_argument('--timeout', type=float, default=5.0, help='response timeout in seconds')
+    args = parser.parse_args()
+
+    results = {}
+    deadline = time.monotonic() + args.duration
+    threads = [threading.Thread(target=poller, args=(args, i, deadline, results)) for i in range(args.clients)]
+    start = time.monotonic()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    duration = time.monotonic() - start
+
+    allLatencies = []
+    allErrors = 0
+    for clientId in sorted(results):
+        latencies, errors = results[clientId]
+        report('client%d' % clientId, latencies, errors, duration)
+        allLatencies += latencies
+        allErrors += errors
+    report('total', allLatencies, allErrors, duration)
+
+
+if __name__ == '__main__':
+    main()